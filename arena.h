@@ -0,0 +1,173 @@
+/*====================================================================
+
+  PER-WORKER BUFFER ARENAS AND ALLOCATION COUNTER:
+
+  workerArena<T>() gives the calling thread its own object T holding
+  the buffers of a processing path (see WorkBuffers in the tools).
+  Buffers are cleared, never freed, between files, so once they have
+  grown to the largest file they are not allocated again.
+
+  Compiled with -DCOUNT_ALLOC the program counts calls of operator
+  new; allocCount() gives the number so far (-1 without counting).
+  The tools print it after each file: after the first files it grows
+  only by the copies of file names too long to be kept inside a
+  string, a few per file whatever its size. Memory taken by malloc
+  is not counted: the C library, zlib and zstd allocate the state of
+  each open file (fopen, gzopen, ZSTD_createDStream) that way.
+  ArenaAllocator keeps freed single objects (nodes of sets and maps)
+  of the thread for reuse instead of freeing them.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+#ifdef COUNT_ALLOC
+/*--------------------------------------------------------------------
+  Counting operator new. The header is included by one source file
+  of each program, so the replacement is defined once. The operators
+  are kept out of line, so the compiler sees no free() of memory
+  from operator new.
+--------------------------------------------------------------------*/
+inline std::atomic<long> &allocCounter()
+{
+  static std::atomic<long> count(0);
+  return count;
+}
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+  ++allocCounter();
+  void *p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void *operator new[](size_t size)
+  { return operator new(size); }
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+  { free(p); }
+
+__attribute__((noinline)) void operator delete[](void *p) noexcept
+  { free(p); }
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+  { free(p); }
+
+__attribute__((noinline)) void operator delete[](void *p, size_t) noexcept
+  { free(p); }
+
+inline long allocCount() { return allocCounter().load(); }
+#else
+inline long allocCount() { return -1; }
+#endif
+
+
+/*--------------------------------------------------------------------
+  Buffers of type T owned by the calling thread.
+--------------------------------------------------------------------*/
+template <class T> T &workerArena()
+{
+  static thread_local T arena;
+  return arena;
+}
+
+
+/*--------------------------------------------------------------------
+  Allocator of node containers recycling freed nodes in a free list
+  of the thread; the list is released when the thread ends.
+--------------------------------------------------------------------*/
+template <class T> struct ArenaAllocator
+{
+  typedef T value_type;
+
+  ArenaAllocator() {}
+  template <class U> ArenaAllocator(const ArenaAllocator<U> &) {}
+
+  struct FreeList
+  {
+    std::vector<void *> nodes;
+    ~FreeList()
+      { for (size_t i = 0; i < nodes.size(); ++i) ::operator delete(nodes[i]); }
+  };
+
+  static std::vector<void *> &freeNodes()
+  {
+    static thread_local FreeList list;
+    return list.nodes;
+  }
+
+  T *allocate(size_t n)
+  {
+    std::vector<void *> &nodes = freeNodes();
+    if ( (n == 1) && !nodes.empty() ) {
+      void *p = nodes.back();
+      nodes.pop_back();
+      return static_cast<T *>(p);
+    }
+    return static_cast<T *>(::operator new(n*sizeof(T)));
+  }
+
+  void deallocate(T *p, size_t n)
+  {
+    if (n == 1)
+      freeNodes().push_back(p);
+    else
+      ::operator delete(p);
+  }
+};
+
+template <class T, class U>
+inline bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+
+template <class T, class U>
+inline bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+
+/*--------------------------------------------------------------------
+  Set the number of columns of the table and empty them, keeping
+  the memory of the columns.
+--------------------------------------------------------------------*/
+inline void arenaResetTable(std::vector<std::vector<double> > &t, int ncol)
+{
+  t.resize(ncol);
+  for (int k = 0; k < ncol; ++k) t[k].clear();
+}
+
+
+/*--------------------------------------------------------------------
+  Write the text to the file with plain system calls (no buffers of
+  the C library or of streams are allocated).
+--------------------------------------------------------------------*/
+inline bool arenaWriteFile(const std::string &name, const std::string &text)
+{
+  int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return false;
+  size_t done = 0;
+  while (done < text.size()) {
+    ssize_t r = write(fd, text.data() + done, text.size() - done);
+    if (r <= 0) break;
+    done += r;
+  }
+  return (close(fd) == 0) && (done == text.size());
+}
+
+
+#endif // ARENA_H
+
+
+//====================================================================
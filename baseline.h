@@ -0,0 +1,154 @@
+/*====================================================================
+
+  BASELINE BY ASYMMETRIC LEAST SQUARES:
+
+  The baseline z of the data y minimizes
+
+    sum_i w_i (y_i - z_i)^2 + lambda sum_i (z_i - 2 z_{i+1} + z_{i+2})^2,
+
+  with the weight w_i = p of points above the baseline and 1 - p of
+  points below it, so that a small p keeps z under the peaks (Eilers
+  & Boelens). Starting from unit weights, the weights are updated
+  from the last baseline until they do not change. Each iteration
+  solves the least squares problem of the stacked rows sqrt(W) and
+  sqrt(lambda) D by Givens rotations into a banded triangular factor.
+  Unlike the normal equations (W + lambda D'D) z = W y, which lose all
+  digits for the large lambda of broad baselines of long spectra, the
+  rotations keep the accuracy, and cost O(n) time and memory of a few
+  vectors, so spectra of 10^7 points take seconds.
+  The baseline follows features wider than about lambda^(1/4) points.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <math.h>
+#include <vector>
+
+
+/*--------------------------------------------------------------------
+  Banded upper triangular factor R of the least squares problem with
+  up to three nonzeros per row, and Q'b.
+--------------------------------------------------------------------*/
+class BaselineFactor
+{
+  private: std::vector<double> r0, r1, r2;   // R(j,j), R(j,j+1), R(j,j+2).
+  private: std::vector<double> c;            // Right hand side Q'b.
+
+
+  /*------------------------------------------------------------------
+    Empty factor of "n" columns.
+  ------------------------------------------------------------------*/
+  public: void init(int n)
+    { r0.assign(n, 0.0); r1.assign(n, 0.0); r2.assign(n, 0.0); c.assign(n, 0.0); }
+
+
+  /*------------------------------------------------------------------
+    Rotate the row "v0 v1 v2 | b" starting at the column "j" into the
+    factor. The row is rotated into the rows j, j+1, ... of R until
+    nothing is left of it.
+  ------------------------------------------------------------------*/
+  public: void addRow(int j, double v0, double v1, double v2, double b)
+  {
+    int n = r0.size();
+    for (int k = j; k < n; ++k) {
+      if ( (v0 == 0.0) && (v1 == 0.0) && (v2 == 0.0) ) return;
+      if (v0 != 0.0) {
+        double h = sqrt(r0[k]*r0[k] + v0*v0);
+        double cs = r0[k]/h, sn = v0/h;
+        double t;
+        r0[k] = h;
+        t = r1[k]; r1[k] = cs*t + sn*v1; v1 = cs*v1 - sn*t;
+        t = r2[k]; r2[k] = cs*t + sn*v2; v2 = cs*v2 - sn*t;
+        t = c[k]; c[k] = cs*t + sn*b; b = cs*b - sn*t;
+      }
+      v0 = v1; v1 = v2; v2 = 0.0;
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Solution "z" of R z = Q'b.
+  ------------------------------------------------------------------*/
+  public: void solve(std::vector<double> &z)
+  {
+    int n = r0.size();
+    for (int k = n - 1; k >= 0; --k) {
+      double v = c[k];
+      if (k + 1 < n) v -= r1[k]*z[k+1];
+      if (k + 2 < n) v -= r2[k]*z[k+2];
+      z[k] = v/r0[k];
+    }
+  }
+
+
+}; //=================================================================
+
+
+/*--------------------------------------------------------------------
+  Baseline "z" of the data "y" by asymmetric least squares. Returns
+  the number of iterations done.
+--------------------------------------------------------------------*/
+inline int alsBaseline(
+  const std::vector<double> &y,   // Data.
+  double lambda,                  // Smoothness of the baseline.
+  double p,                       // Weight of points above the baseline.
+  int niter,                      // Maximal number of iterations.
+  std::vector<double> &z)         // Result baseline.
+{
+  static thread_local BaselineFactor f;     // Kept for the next call.
+  static thread_local std::vector<char> up;  // Points above the baseline.
+  int n = y.size();
+  z = y;
+  if (n < 3) return 0;
+  up.assign(n, 0);
+  double sl = sqrt(lambda), sp = sqrt(p), sq = sqrt(1.0 - p);
+
+  int it = 0;
+  bool same = false;
+  while (it < niter) {
+    // Weights from the last baseline, unit ones at first.
+    same = (it > 0);
+    for (int i = 0; (it > 0) && (i < n); ++i) {
+      char u = (y[i] > z[i]);
+      if (u != up[i]) { up[i] = u; same = false; }
+    }
+    if (same) break;
+
+    // Rows of the smoothness and of the data in order of columns.
+    f.init(n);
+    for (int j = 0; j < n; ++j) {
+      if (j + 2 < n) f.addRow(j, sl, -2.0*sl, sl, 0.0);
+      double w = (it == 0) ? 1.0 : (up[j] ? sp : sq);
+      f.addRow(j, w, 0.0, 0.0, w*y[j]);
+    }
+    f.solve(z);
+    ++it;
+  }
+  return it;
+}
+
+
+/*--------------------------------------------------------------------
+  Subtract the baseline by asymmetric least squares from the data
+  "y" in place. Returns the number of iterations done.
+--------------------------------------------------------------------*/
+inline int removeBaseline(std::vector<double> &y, double lambda, double p, int niter)
+{
+  static thread_local std::vector<double> z;   // Kept for the next call.
+  int it = alsBaseline(y, lambda, p, niter, z);
+  for (int i = 0; i < y.size(); ++i)
+    y[i] -= z[i];
+  return it;
+}
+
+
+#endif // BASELINE_H
+
+
+//====================================================================
@@ -18,6 +18,9 @@
 #include <iostream>
 #include <vector>
 #include <sys/stat.h>
+#include "zstream.h"
+#include "pack.h"
+#include "baseline.h"
 
 using namespace std;
 
@@ -43,15 +46,32 @@ const string file_name[] = { "540-plex.dat",
   "Ag15_lb=11B_TPP_SF1=2_SF2=2_Ang1=00_Th=5_p5i.dat"
    };
 
+/* Output mode:
+    0 : text files "norm_<name>";
+    1 : all outputs in the pack pack_name under the same names (see pack.h). */
+const int out_mode = 0;
+const string pack_name = "norm.pack";
+
+/* Baseline removal before normalization (see baseline.h):
+    0 : none;
+    1 : baseline by asymmetric least squares of smoothness base_lambda
+        (features wider than base_lambda^(1/4) points) and weight
+        base_p of points above it, at most base_iter iterations,
+        subtracted from every column. */
+const int base_mode = 0;
+const double base_lambda = 1.0e8;
+const double base_p = 0.01;
+const int base_iter = 10;
+
 
 /*********************************************************************
   The Code.
 *********************************************************************/
 
 /*--------------------------------------------------------------------
-  Read data.
+  Read data "x y1 ... yk", one vector per column of values.
 --------------------------------------------------------------------*/
-void read(string name, vector<double> &x, vector<double> &y)
+void read(string name, vector<double> &x, vector<vector<double> > &y)
 {
   x.clear(); y.clear();
   struct stat st;
@@ -59,11 +79,27 @@ void read(string name, vector<double> &x, vector<double> &y)
     cout << "File " << name << " not found!\n";
     exit(0);
   } else {
-    ifstream fin(name.c_str(), ios::in);
-    while (!fin.eof()) {
-      double tmp;
-      fin >> tmp; if(!fin.eof()) x.push_back(tmp);
-      fin >> tmp; if(!fin.eof()) y.push_back(tmp);
+    DataInputStream fin(name);
+    string s;
+    vector<double> row;
+    while (getline(fin, s)) {
+      row.clear();
+      const char *p = s.c_str();
+      char *end;
+      for (double tmp = strtod(p, &end); end != p; tmp = strtod(p, &end)) {
+        row.push_back(tmp);
+        p = end;
+      }
+      if (row.size() < 2) continue;
+      if (y.empty()) y.resize(row.size() - 1);
+      if (row.size() - 1 < y.size()) continue;
+      x.push_back(row[0]);
+      for (int k = 0; k < y.size(); ++k)
+        y[k].push_back(row[k + 1]);
+    }
+    if (!fin.error().empty()) {
+      cout << fin.error() << "\n";
+      exit(0);
     }
     fin.close();
   }
@@ -98,25 +134,52 @@ int main(int argc, char **argv)
   fout_p << "set key reverse Left at graph 0.7, 0.2\n";
   fout_p << "plot \\" << endl;
 
+  PackWriter pack;
+  if ( (out_mode == 1) && !pack.open(pack_name) ) {
+    cout << "Can not open pack " << pack_name << "!\n";
+    exit(0);
+  }
+
   for (int i = 0; i < file_num; ++i) {
 
-    vector<double> x, y;
+    vector<double> x;
+    vector<vector<double> > y;
     read(file_name[i], x, y);
-    normalize(y);
+    int ncol = y.size();
+    for (int k = 0; k < ncol; ++k) {
+      if (base_mode == 1)
+        removeBaseline(y[k], base_lambda, base_p, base_iter);
+      normalize(y[k]);
+    }
 
     string out_name = "norm_" + file_name[i];
-    ofstream fout_d(out_name.c_str(), ios::out);
-    for (int j = 0; j < x.size(); ++j)
-      fout_d << x[j] << " " << y[j] << "\n";
-    fout_d.close();
-
-    fout_p << "\"" << out_name << "\" u 1:2 w l smooth mcsplines";
-    if (i < file_num-1)
-      fout_p << ", \\" << endl;
-    else
-      fout_p << endl;
+    string source = "\"" + out_name + "\"";
+    if (out_mode == 1) {
+      string rec;
+      packRecord(out_name, x, y, false, rec);
+      source = packGnuplotSource(pack_name, pack.append(rec), x.size(), ncol);
+    } else {
+      ofstream fout_d(out_name.c_str(), ios::out);
+      for (int j = 0; j < x.size(); ++j) {
+        fout_d << x[j];
+        for (int k = 0; k < ncol; ++k)
+          fout_d << " " << y[k][j];
+        fout_d << "\n";
+      }
+      fout_d.close();
+    }
+
+    for (int k = 0; k < ncol; ++k) {
+      fout_p << source << " u 1:" << k + 2 << " w l smooth mcsplines";
+      if ((i < file_num-1) || (k < ncol-1))
+        fout_p << ", \\" << endl;
+      else
+        fout_p << endl;
+    }
   }
   fout_p.close();
+  if (!pack.close())
+    cout << "Can not write pack " << pack_name << "!\n";
 
   string command = "gnuplot " + plt_name;
   system(command.c_str());
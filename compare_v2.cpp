@@ -17,17 +17,22 @@
 #include <vector>
 #include <sstream>
 #include <sys/stat.h>
+#include "zstream.h"
+#include "uniform_axis.h"
+#include "baseline.h"
 
 
 // ===== Parameters ====================================================================================================
 
-// Files with data to compare
+// Files with data to compare, replaced by the file arguments of the program if given. The plot of the file arguments
+// f1 ... is compare-f1.png (script compare-f1.plt), so that runs over other files in parallel do not overwrite it.
 const int data_file_num = 3;
 const std::string data_file_name[] = {  "11nm-Bare-Exp.dat",
                                         "11nm-Bare-Num.dat",
                                         "avr2d_extinct_crossect.dat"};
 
-// Extra factors to multiply the data to correct errors in maxima detection caused by lack of interpolation.
+// Extra factors to multiply the data to correct errors in maxima detection caused by lack of interpolation (1 for
+// the file arguments).
 const double extra_fact[] = { 1.0, 1.0, 0.94 };
 
 // Wavelength range to plot 
@@ -38,34 +43,69 @@ const double plot_wl_max = 750.0;
 const double srch_wl_min = 550.0;
 const double srch_wl_max = 700.0;
 
+// Baseline removal before the maxima search (see baseline.h): 0 - none, 1 - baseline by asymmetric least squares of
+// smoothness base_lambda (features wider than base_lambda^(1/4) points) and weight base_p of points above it, at most
+// base_iter iterations, subtracted from every column
+const int base_mode = 0;
+const double base_lambda = 1.0e8;
+const double base_p = 0.01;
+const int base_iter = 10;
 
-// ----- Read two column data from file --------------------------------------------------------------------------------
-bool readTwoColumnData(
+
+// ----- Read multi column data "x y1 ... yk" from file, arguments of uniform step are kept as the axis only -----------
+bool readMultiColumnData(
   const std::string &name,                  // Name of the file to load the data.
-  std::vector<double> &x,                   // Result std::vector of arguments.
-  std::vector<double> &y)                   // Result std::vector of function values.
+  UniformAxis &ax,                          // Result uniform axis of arguments, if any.
+  std::vector<double> &x,                   // Result std::vector of arguments, empty for the uniform axis.
+  std::vector<std::vector<double> > &y)     // Result std::vectors of function values, one per column.
 {
-  x.clear(); y.clear();
+  ax.clear(); x.clear(); y.clear();
   struct stat st;
-  if (stat(name.c_str(), &st) != 0)
+  if (stat(name.c_str(), &st) != 0) {
+    std::cout << "File " << name << " not found!" << std::endl;
     return false;
-  else {
-    std::ifstream fin(name.c_str(), std::ios::in);
-    while (!fin.eof()) {
-      double tmp;
-      fin >> tmp; if(!fin.eof()) x.push_back(tmp);
-      fin >> tmp; if(!fin.eof()) y.push_back(tmp);
+  } else {
+    DataInputStream fin(name);
+    std::string s;
+    std::vector<double> row;
+    while (getline(fin, s)) {
+      row.clear();
+      const char *p = s.c_str();
+      char *end;
+      for (double tmp = strtod(p, &end); end != p; tmp = strtod(p, &end)) {
+        row.push_back(tmp);
+        p = end;
+      }
+      if (row.size() < 2) continue;
+      if (y.empty()) y.resize(row.size() - 1);
+      if (row.size() - 1 < y.size()) continue;
+      x.push_back(row[0]);
+      for (int k = 0; k < y.size(); ++k)
+        y[k].push_back(row[k + 1]);
+    }
+    if (!fin.error().empty()) {
+      std::cout << fin.error() << std::endl;
+      return false;
     }
     fin.close();
+    if (ax.init(x)) std::vector<double>().swap(x);
     return true;
   }
 }
 
 
 // ----- Get maximal value of vector of positive values 'y' within the range [x_min, x_max] ----------------------------
-double getMax(const double &x_min, const double &x_max, const std::vector<double> &x, const std::vector<double> &y)
+double getMax(const double &x_min, const double &x_max, const UniformAxis &ax, const std::vector<double> &x,
+  const std::vector<double> &y)
 {
   double res = 0.0;
+  if (ax.isUniform()) {
+    int i_min, i_max;
+    ax.range(x_min, x_max, i_min, i_max);
+    for (int i = i_min; i <= i_max; ++i)
+      if (res < y[i]) res = y[i];
+    return res;
+  }
   for (int i = 0; i < x.size(); ++i)
     if ( (x_min <= x[i]) && (x[i] <= x_max) && (res < y[i]) ) res = y[i];
   return res;
@@ -73,40 +113,65 @@ double getMax(const double &x_min, const double &x_max, const std::vector<double
 
 
 //**********************************************************************************************************************
-int main(void)
+int main(int argc, char **argv)
 {
-  std::vector<double> x, y;
+  std::vector<std::string> files(data_file_name, data_file_name + data_file_num);
+  std::vector<double> factor(extra_fact, extra_fact + data_file_num);
+  if (argc > 1) {
+    files.assign(argv + 1, argv + argc);
+    factor.assign(argc - 1, 1.0);
+  }
+  int nfile = files.size();
+  UniformAxis ax;
+  std::vector<double> x;
+  std::vector<std::vector<double> > y;
+  std::vector<int> col_num(nfile, 0);
   std::string file_name;
   std::ofstream fout;
 
-  for (int i = 0; i < data_file_num; ++i) {
-
-    readTwoColumnData(data_file_name[i], x, y);
-    double tmp = getMax(srch_wl_min, srch_wl_max, x, y);
-    if (tmp <= 0.0) { std::cout << "No maxima found in file " << data_file_name[i] << std::endl; exit(0); }
-    tmp = 1.0/tmp;
+  for (int i = 0; i < nfile; ++i) {
+
+    if (!readMultiColumnData(files[i], ax, x, y)) exit(0);
+    int n = ax.isUniform() ? ax.size() : x.size();
+    int ncol = y.size();
+    col_num[i] = ncol;
+    for (int k = 0; k < ncol; ++k) {
+      if (base_mode == 1)
+        removeBaseline(y[k], base_lambda, base_p, base_iter);
+      double tmp = getMax(srch_wl_min, srch_wl_max, ax, x, y[k]);
+      if (tmp <= 0.0) { std::cout << "No maxima found in file " << files[i] << std::endl; exit(0); }
+      tmp = factor[i]/tmp;
+      for (int j = 0; j < n; ++j)
+        y[k][j] *= tmp;
+    }
 
-    file_name = "scale-" + data_file_name[i];
+    file_name = "scale-" + files[i];
     fout.open(file_name.c_str(), std::ios::out);
-    for (int j = 0; j < x.size(); ++j)
-      fout << x[j] << " " << extra_fact[i]*tmp*y[j] << std::endl;
+    for (int j = 0; j < n; ++j) {
+      fout << (ax.isUniform() ? ax.at(j) : x[j]);
+      for (int k = 0; k < ncol; ++k)
+        fout << " " << y[k][j];
+      fout << "\n";
+    }
     fout.close();
   }
 
-  file_name = "compare.plt";
+  std::string plot_tag = (argc > 1) ? "-" + files[0] : "";
+  file_name = "compare" + plot_tag + ".plt";
   fout.open(file_name.c_str(), std::ios::out);
   fout << "set term png enhanced size 1024,768" << std::endl;
-  fout << "set output \"compare.png\"" << std::endl;
+  fout << "set output \"compare" << plot_tag << ".png\"" << std::endl;
   fout << "set xrange[" << plot_wl_min << " : " << plot_wl_max << "]" << std::endl;
   fout << "set grid xtics ytics mxtics mytics" << std::endl;
   fout << "set mxtics 2" << std::endl;
   fout << "set mytics 2" << std::endl;
   fout << "set grid" << std::endl;
   fout << "plot \\" << std::endl;
-  for (int i = 0; i < data_file_num; ++i) {
-    fout << "\"scale-" << data_file_name[i] << "\" u 1:2 w l lw 3 smooth csplines";
-    if (i < (data_file_num-1)) fout << ", \\" << std::endl;
-  }
+  for (int i = 0; i < nfile; ++i)
+    for (int k = 0; k < col_num[i]; ++k) {
+      fout << "\"scale-" << files[i] << "\" u 1:" << k + 2 << " w l lw 3 smooth csplines";
+      if ((i < (nfile-1)) || (k < (col_num[i]-1))) fout << ", \\" << std::endl;
+    }
   fout.close();
 
   std::string command = "C:\\Soft\\gnuplot\\bin\\gnuplot.exe " + file_name;
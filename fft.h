@@ -0,0 +1,216 @@
+/*====================================================================
+
+  FAST FOURIER TRANSFORM AND INSTRUMENT RESPONSE:
+
+  Radix-2 complex FFT with plans (twiddle factors and bit reversal)
+  cached by size, so spectra of the same length in a batch share one
+  plan. FFTResponse convolves data on a uniform grid with a Gaussian
+  or Lorentzian instrument response, or deconvolves it with Tikhonov
+  regularization, in O(n log n). The response is even, so its
+  transform is real and two columns are filtered by one complex
+  transform (first one in the real part, second in the imaginary).
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <math.h>
+#include <complex>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+/*--------------------------------------------------------------------
+  Smallest power of two not less than n.
+--------------------------------------------------------------------*/
+inline int fftSize(int n)
+{
+  int m = 1;
+  while (m < n) m <<= 1;
+  return m;
+}
+
+
+class FFTPlan
+{
+  private: int n;                                 // Size, power of two.
+  private: std::vector<std::complex<double> > w;  // exp(-2 pi i k/n), k < n/2.
+  private: std::vector<int> rev;                  // Bit reversed indexes.
+
+
+  /*------------------------------------------------------------------
+    Constructor.
+  ------------------------------------------------------------------*/
+  public: FFTPlan(int size)
+  {
+    n = size;
+    w.resize(n/2);
+    for (int k = 0; k < n/2; ++k)
+      w[k] = std::polar(1.0, -2.0*M_PI*k/n);
+    rev.resize(n);
+    int lg = 0;
+    while ((1 << lg) < n) ++lg;
+    for (int i = 0; i < n; ++i) {
+      int r = 0;
+      for (int b = 0; b < lg; ++b)
+        if (i & (1 << b)) r |= 1 << (lg - 1 - b);
+      rev[i] = r;
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Size of the plan.
+  ------------------------------------------------------------------*/
+  public: int size() const { return n; }
+
+
+  /*------------------------------------------------------------------
+    In place transform of "a", the inverse one is scaled by 1/n.
+  ------------------------------------------------------------------*/
+  public: void transform(std::complex<double> *a, bool inverse) const
+  {
+    for (int i = 0; i < n; ++i)
+      if (i < rev[i]) std::swap(a[i], a[rev[i]]);
+    for (int len = 2; len <= n; len <<= 1) {
+      int half = len/2, step = n/len;
+      for (int i = 0; i < n; i += len)
+        for (int k = 0; k < half; ++k) {
+          std::complex<double> t = inverse ? std::conj(w[k*step]) : w[k*step];
+          t *= a[i + k + half];
+          a[i + k + half] = a[i + k] - t;
+          a[i + k] += t;
+        }
+    }
+    if (inverse) {
+      double s = 1.0/n;
+      for (int i = 0; i < n; ++i) a[i] *= s;
+    }
+  }
+
+
+}; //=================================================================
+
+
+/*--------------------------------------------------------------------
+  Plan of the size (power of two), made once and shared by threads.
+--------------------------------------------------------------------*/
+inline const FFTPlan &fftPlan(int n)
+{
+  static std::map<int, std::unique_ptr<FFTPlan> > plans;
+  static std::mutex mtx;
+  std::lock_guard<std::mutex> lock(mtx);
+  std::unique_ptr<FFTPlan> &p = plans[n];
+  if (!p) p.reset(new FFTPlan(n));
+  return *p;
+}
+
+
+/*--------------------------------------------------------------------
+  Response shapes and modes.
+--------------------------------------------------------------------*/
+const int FFT_GAUSS = 0;
+const int FFT_LORENTZ = 1;
+
+const int FFT_CONVOLVE = 1;
+const int FFT_DECONVOLVE = 2;
+
+
+class FFTResponse
+{
+  private: int n;                   // Number of data points.
+  private: int pad;                 // Points added at each edge.
+  private: const FFTPlan *plan;
+  private: std::vector<double> h;   // Filter in the frequency domain.
+
+
+  /*------------------------------------------------------------------
+    Constructor.
+  ------------------------------------------------------------------*/
+  public: FFTResponse()
+    { n = 0; pad = 0; plan = NULL; }
+
+
+  /*------------------------------------------------------------------
+    Initialization for "npts" points with the step "dx". The response
+    is cut at 6 sigma (Gaussian) or 50 half widths (Lorentzian) and
+    normalized to unit area. Data is extended by its edge values over
+    the response width so the circular transform gives the linear
+    convolution.
+  ------------------------------------------------------------------*/
+  public: void init(
+    int npts,         // Number of data points.
+    double dx,        // Grid step.
+    int shape,        // FFT_GAUSS or FFT_LORENTZ.
+    double fwhm,      // Full width at half maximum of the response.
+    int mode,         // FFT_CONVOLVE or FFT_DECONVOLVE.
+    double reg)       // Regularization of deconvolution.
+  {
+    n = npts;
+    double width = (shape == FFT_GAUSS) ? 6.0*fwhm/2.35482 : 50.0*fwhm/2.0;
+    pad = std::min(int(ceil(width/dx)), 4*n);
+    int m = fftSize(n + 2*pad);
+    plan = &fftPlan(m);
+
+    // Response sampled around zero with wrap-around.
+    std::vector<std::complex<double> > k(m, 0.0);
+    double sum = 0.0;
+    for (int i = -pad; i <= pad; ++i) {
+      double t = i*dx;
+      double v = (shape == FFT_GAUSS)
+        ? exp(-4.0*log(2.0)*t*t/(fwhm*fwhm))
+        : 1.0/(1.0 + 4.0*t*t/(fwhm*fwhm));
+      k[(i + m)%m] = v;
+      sum += v;
+    }
+    for (int i = 0; i < m; ++i) k[i] /= sum;
+    plan->transform(&k[0], false);
+
+    // Real filter: K for convolution, K/(K^2 + reg) for deconvolution.
+    h.resize(m);
+    for (int i = 0; i < m; ++i) {
+      double kr = k[i].real();
+      h[i] = (mode == FFT_DECONVOLVE) ? kr/(kr*kr + reg) : kr;
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Filter one or two columns in place. Column values are taken with
+    the stride, "b" may be NULL.
+  ------------------------------------------------------------------*/
+  public: void apply(double *a, double *b, size_t stride) const
+  {
+    int m = plan->size();
+    static thread_local std::vector<std::complex<double> > z;   // Kept for the next call.
+    z.resize(m);
+    for (int i = 0; i < m; ++i) {
+      int j = std::min(std::max(i - pad, 0), n - 1);   // Edge values outside.
+      if (i >= n + 2*pad) j = (i - n - 2*pad < (m - n - 2*pad)/2) ? n - 1 : 0;
+      z[i] = std::complex<double>(a[j*stride], (b != NULL) ? b[j*stride] : 0.0);
+    }
+    plan->transform(&z[0], false);
+    for (int i = 0; i < m; ++i) z[i] *= h[i];
+    plan->transform(&z[0], true);
+    for (int i = 0; i < n; ++i) {
+      a[i*stride] = z[i + pad].real();
+      if (b != NULL) b[i*stride] = z[i + pad].imag();
+    }
+  }
+
+
+}; //=================================================================
+
+
+#endif // FFT_H
+
+
+//====================================================================
@@ -0,0 +1,127 @@
+/*====================================================================
+
+  ADAPTIVE CHOICE OF SPLINE KNOTS AMONG THE DATA POINTS:
+
+  Knots are chosen in one pass by the "swinging door" rule: from the
+  last knot the segment is extended while one straight line passes
+  within the tolerance of every point of it, for every column. The
+  tolerance is "nsigma" noise levels of the column, so deviations
+  within the noise never add a knot, and the segment length follows
+  the local curvature as sqrt(8*tolerance/|y''|): flat baselines get
+  few knots, peaks keep their points. The tolerance is not less than
+  the given fraction of the column range, for data without noise.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef KNOTS_H
+#define KNOTS_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+
+/*--------------------------------------------------------------------
+  Noise level of the data: median of absolute second differences
+  scaled to sigma of Gaussian noise. Second differences leave out
+  the smooth signal on fine grids.
+--------------------------------------------------------------------*/
+inline double knotsNoise(const std::vector<double> &y)
+{
+  int n = y.size();
+  if (n < 3) return 0.0;
+  static thread_local std::vector<double> d;   // Kept for the next call.
+  d.resize(n - 2);
+  for (int i = 1; i < n - 1; ++i)
+    d[i-1] = fabs(y[i+1] - 2.0*y[i] + y[i-1]);
+  std::nth_element(d.begin(), d.begin() + d.size()/2, d.end());
+  return d[d.size()/2]/(0.67449*sqrt(6.0));
+}
+
+
+/*--------------------------------------------------------------------
+  Indexes of the knots, the first and the last points included.
+--------------------------------------------------------------------*/
+inline void selectKnots(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  double nsigma,                                // Tolerance in noise levels.
+  double rel_tol,                               // Minimal tolerance, fraction of the range.
+  int max_step,                                 // Maximal number of points between knots.
+  std::vector<int> &idx)                        // Result indexes of knots.
+{
+  int n = x.size();
+  int ncol = y.size();
+  idx.clear();
+  if (n == 0) return;
+  idx.push_back(0);
+
+  static thread_local std::vector<double> tol, lo, hi;
+  tol.resize(ncol); lo.resize(ncol); hi.resize(ncol);
+  for (int k = 0; k < ncol; ++k) {
+    double range = *std::max_element(y[k].begin(), y[k].end())
+      - *std::min_element(y[k].begin(), y[k].end());
+    tol[k] = std::max(nsigma*knotsNoise(y[k]), rel_tol*range);
+  }
+
+  int a = 0;                      // Last knot.
+  for (int k = 0; k < ncol; ++k) {
+    lo[k] = -std::numeric_limits<double>::max();
+    hi[k] = std::numeric_limits<double>::max();
+  }
+  for (int i = 1; i < n; ++i) {
+
+    // Narrow the door of slopes from the knot, close it at failure.
+    bool open = (i - a <= max_step);
+    double dx = x[i] - x[a];
+    for (int k = 0; (k < ncol) && open; ++k) {
+      double dy = y[k][i] - y[k][a];
+      hi[k] = std::min(hi[k], (dy + tol[k])/dx);
+      lo[k] = std::max(lo[k], (dy - tol[k])/dx);
+      open = (lo[k] <= hi[k]);
+    }
+    if (open) continue;
+
+    // New knot at the previous point, the door opens from it.
+    a = i - 1;
+    idx.push_back(a);
+    dx = x[i] - x[a];
+    for (int k = 0; k < ncol; ++k) {
+      double dy = y[k][i] - y[k][a];
+      hi[k] = (dy + tol[k])/dx;
+      lo[k] = (dy - tol[k])/dx;
+    }
+  }
+  if (idx.back() != n - 1) idx.push_back(n - 1);
+}
+
+
+/*--------------------------------------------------------------------
+  Keep only the points with the indexes.
+--------------------------------------------------------------------*/
+inline void keepKnots(
+  std::vector<double> &x,                   // Arguments.
+  std::vector<std::vector<double> > &y,     // Function values, one vector per column.
+  const std::vector<int> &idx)              // Indexes of points to keep, increasing.
+{
+  int m = idx.size();
+  for (int j = 0; j < m; ++j) {
+    x[j] = x[idx[j]];
+    for (int k = 0; k < y.size(); ++k)
+      y[k][j] = y[k][idx[j]];
+  }
+  x.resize(m);
+  for (int k = 0; k < y.size(); ++k)
+    y[k].resize(m);
+}
+
+
+#endif // KNOTS_H
+
+
+//====================================================================
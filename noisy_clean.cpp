@@ -17,6 +17,18 @@
 #include <iostream>
 #include <sys/stat.h>
 #include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#include "arena.h"
+#include "zstream.h"
+#include "pack.h"
+#include "fft.h"
+#include "running_median.h"
+#include "knots.h"
+#include "spline.h"
+#include "spline_grid.h"
+#include "welford.h"
+#include "sweep.h"
 using namespace std;
 
 
@@ -27,141 +39,415 @@ using namespace std;
 // Number of data files to process.
 const int file_num = 6;
 
-// Names of data files to process.
+// Names of data files to process, replaced by the file arguments of the program if given. The plot of the file
+// arguments f1 ... is cleaned-f1.png (script plot_noisy_clean-f1.plt), so that runs over other files in parallel do
+// not overwrite it.
 const string file_name[] = { "500.dat", "540.dat", "560.dat", "625.dat", "645.dat", "675.dat" };
 
 // Factor to rare data.
 const int rare = 15;
 
+// Hampel despiking of the full data before decimation (see running_median.h): half width of the running median
+// window in input points, 0 to switch off, and threshold in noise sigmas.
+const int hampel_half = 0;
+const double hampel_nsigma = 5.0;
+
+/* Choice of spline knots among the read points:
+    0 : every rare-th point;
+    1 : adaptive by local curvature and noise (see knots.h): tolerance of knot_nsigma noise levels, not less than
+        knot_rel_tol of the range, knots at most knot_max_step points apart. */
+const int knot_mode = 0;
+const double knot_nsigma = 3.0;
+const double knot_rel_tol = 1.0e-3;
+const int knot_max_step = 100;
+
 // Wavelength range [nm].
 const double wI = 375.0;
 const double wF = 800.0;
 const double wS = 2.0;
 
+// Number of threads, 0 for one per core.
+const int thread_num = 0;
+
+// Number of output points evaluated by a thread at once.
+const int eval_chunk = 4096;
+
+/* Output mode:
+    0 : text files "clean-<name>";
+    1 : all outputs in the pack pack_name under the same names (see pack.h). */
+const int out_mode = 0;
+const string pack_name = "clean.pack";
+
+/* Stacking of repeated scans (see welford.h):
+    0 : none, every file is cleaned to its own output;
+    1 : spline fits of all files on the output grid are folded into a running mean and variance, one pass with
+        constant memory; "w mean1 stderr1 ... meank stderrk" is written to stack_name. */
+const int stack_mode = 0;
+const string stack_name = "stack.dat";
+
+/* Parameter sweep (see sweep.h):
+    0 : none;
+    1 : every file is read once at full resolution and fitted for every factor to rare data of sweep_rare (knots of
+        knot_mode = 0 only) and every output step [nm] of sweep_step, settings in parallel; the fits are written to
+        "sweep-<rare>-<step>-<name>", the rms residuals of the data against the fits to sweep_name. */
+const int sweep_mode = 0;
+const int sweep_rare_num = 4;
+const int sweep_rare[] = { 5, 10, 15, 20 };
+const int sweep_step_num = 2;
+const double sweep_step[] = { 1.0, 2.0 };
+const string sweep_name = "sweep.dat";
+
+/* Instrument response stage on the output grid (see fft.h):
+    0 : none;
+    1 : convolution with the response;
+    2 : deconvolution with Tikhonov regularization resp_reg. */
+const int resp_mode = 0;
+
+/* Shape of the response:
+    0 : Gaussian;
+    1 : Lorentzian. */
+const int resp_shape = 0;
+
+// Full width at half maximum of the response [nm].
+const double resp_fwhm = 5.0;
+
+// Regularization of deconvolution, relative to the unit response at zero frequency.
+const double resp_reg = 1.0e-3;
+
+/* Derivatives of the spline fit written to "deriv-<name>" on the output grid:
+    0 : none;
+    1 : first derivatives of all columns;
+    2 : first and second derivatives of all columns. */
+const int deriv_out = 0;
+
+// Ranges [nm] for area, centroid and width (rms) of the spline fit of every column, written to "moments-<name>".
+const int range_num = 0;
+const double range_lo[] = { 500.0 };
+const double range_hi[] = { 600.0 };
+
 
 /*----------------------------------------------------------------------------------------------------------------------
-  Read experimental data.
+  Buffers of the processing path, kept by each thread for the next file (see arena.h).
 ----------------------------------------------------------------------------------------------------------------------*/
-void read_rare(string name, vector<double> &x, vector<double> &y)
+struct WorkBuffers
+{
+  vector<double> x, row, res, der, w, fx;
+  vector<vector<double> > y, y2, yw, fy;
+  vector<int> idx;
+  UniformAxis ua;
+  string line, name, text, rec;
+};
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+  Read experimental data "x y1 ... yk", one vector per column of values.
+----------------------------------------------------------------------------------------------------------------------*/
+void read_rare(const string &name, vector<double> &x, vector<vector<double> > &y, int i_step)
 {
   struct stat st;
   if (stat(name.c_str(), &st) != 0) {
     cout << "File " << name << " not found!\n";
     exit(0);
   } else {
-    ifstream fin;
-    fin.open(name.c_str(), ios::in);
+    WorkBuffers &b = workerArena<WorkBuffers>();
+    string &s = b.line;
+    vector<double> &row = b.row;
+    DataInputStream fin(name);
     int count = 0;
-    while (!fin.eof()) {
-      double tmp_x; fin >> tmp_x;
-      double tmp_y; fin >> tmp_y;
-      if (count % rare == 0) {
-        x.push_back(tmp_x);
-        y.push_back(tmp_y);
+    int ncol = 0;
+    x.clear();
+    while (getline(fin, s)) {
+      row.clear();
+      const char *p = s.c_str();
+      char *end;
+      for (double tmp = strtod(p, &end); end != p; tmp = strtod(p, &end)) {
+        row.push_back(tmp);
+        p = end;
+      }
+      if (row.size() < 2) continue;
+      if (ncol == 0) { ncol = row.size() - 1; arenaResetTable(y, ncol); }
+      if (row.size() - 1 < ncol) continue;
+      if (count % i_step == 0) {
+        x.push_back(row[0]);
+        for (int k = 0; k < ncol; ++k)
+          y[k].push_back(row[k + 1]);
       }
       count++;
     }
+    if (!fin.error().empty()) {
+      cout << fin.error() << "\n";
+      exit(0);
+    }
+    if (ncol == 0) y.clear();
     fin.close();
   }
 }
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-  Cubic spline interpolation subroutines. Adopted from [W. H. Press, S. A. Teukolsky, W. T. Vetterling
-  and B. P. Flannery, "Numerical Recipes in Fortran 77 The Art of Scientific Computing (Vol.1)].
+  Keep every i_step-th point of the data.
 ----------------------------------------------------------------------------------------------------------------------*/
-void ml_spline(vector<double> x, vector<double> y, double yp1, double ypn, vector<double> &y2)
+void decimate(vector<double> &x, vector<vector<double> > &y, int i_step)
 {
-  int n = y.size();
-  double p, qn, sig, un;
-  vector<double> u(n, 0.0);
-
-  y2[0] = -0.5;
-  u[0] = (3.0/(x[1] - x[0]))*((y[1] - y[0])/(x[1] - x[0]) - yp1);
-  for (int i = 1; i <= n-2; ++i) {
-    sig = (x[i] - x[i-1])/(x[i+1] - x[i-1]);
-    p = sig*y2[i-1] + 2.0;
-    y2[i] = (sig - 1.0)/p;
-    u[i] = (6.0*((y[i+1] - y[i])/(x[i+1] - x[i]) - (y[i] - y[i-1])/(x[i] - x[i-1]))/(x[i+1] - x[i-1]) - sig*u[i-1])/p;
+  int m = 0;
+  for (int i = 0; i < x.size(); i += i_step, ++m) {
+    x[m] = x[i];
+    for (int k = 0; k < y.size(); ++k)
+      y[k][m] = y[k][i];
   }
-  qn = 0.5;
-  un = (3.0/(x[n-1] - x[n-2]))*(ypn - (y[n-1] - y[n-2])/(x[n-1] - x[n-2]));
-  y2[n-1] = (un - qn*u[n-2])/(qn*y2[n-2] + 1.0);
-  for (int k = n - 2; k >= 0; --k)
-    y2[k] = y2[k]*y2[k + 1] + u[k];
+  x.resize(m);
+  for (int k = 0; k < y.size(); ++k)
+    y[k].resize(m);
 }
 
-double ml_splint(vector<double> xa, vector<double> ya, vector<double> y2a, double x)
+
+/*----------------------------------------------------------------------------------------------------------------------
+  Spline fit of the file on the output grid, point by point, into the "res" buffer of the thread. Returns the number
+  of value columns.
+----------------------------------------------------------------------------------------------------------------------*/
+int fitScan(const string &data_file_name, ThreadPool &pool, const FFTResponse &resp)
 {
-  int n = xa.size();
-
-  int klo = 0;
-  int khi = n - 1;
-  while ((khi - klo) > 1) {
-    int k = (khi + klo)/2;
-    if(xa[k] > x)
-      khi = k;
-    else
-      klo = k;
-  }
-  double h = xa[khi] - xa[klo];
-  if (h == 0.0) {
-    cout << "bad xa input in ml_splint!\n";
-    exit(0);
-  }
-  double a = (xa[khi] - x)/h;
-  double b = (x - xa[klo])/h;
-  double y = a*ya[klo] + b*ya[khi] + ((a*a*a - a)*y2a[klo] + (b*b*b - b)*y2a[khi])*h*h/6.0;
-  return y;
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  vector<double> &x = b.x;
+  vector<vector<double> > &y = b.y, &y2 = b.y2;
+  bool full = (hampel_half > 0) || (knot_mode == 1);
+  read_rare(data_file_name, x, y, full ? 1 : rare);
+  if (hampel_half > 0)
+    pool.parallelFor(y.size(), [&](int k) { hampelFilter(y[k], hampel_half, hampel_nsigma); });
+  if (knot_mode == 1) {
+    selectKnots(x, y, knot_nsigma, knot_rel_tol, knot_max_step, b.idx);
+    keepKnots(x, y, b.idx);
+  } else if (full)
+    decimate(x, y, rare);
+
+  int nn = int((wF - wI)/wS) + 1;
+  fitGrid(x, y, y2, b.ua, wI, wS, nn, eval_chunk, (resp_mode != 0) ? &resp : NULL, b.res, pool);
+
+  // Derivatives and moments of the spline fit.
+  if (deriv_out > 0)
+    writeDerivatives("deriv-" + data_file_name, x, y, y2, b.ua, wI, wS, nn, deriv_out, eval_chunk, b.der,
+      b.text, pool);
+  if (range_num > 0)
+    writeMoments("moments-" + data_file_name, x, y, y2, b.ua, range_num, range_lo, range_hi, b.text);
+  return y.size();
 }
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-  Work.
+  Work. Returns the number of value columns processed. The fit is written in order of the output points. In pack
+  mode "pack_pos" is set to the offset of the rows in the pack.
 ----------------------------------------------------------------------------------------------------------------------*/
-void work(const string &data_file_name)
+int work(const string &data_file_name, ThreadPool &pool, const FFTResponse &resp, PackWriter &pack, uint64_t &pack_pos)
 {
-  vector<double> x, y, y2;
-  read_rare(data_file_name, x, y);
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  int ncol = fitScan(data_file_name, pool, resp);
+  int nn = int((wF - wI)/wS) + 1;
+  vector<double> &res = b.res;
+
+  string &file_name = b.name;
+  file_name.assign("clean-");
+  file_name += data_file_name;
+  if (out_mode == 1) {
+    vector<double> &w = b.w;
+    vector<vector<double> > &yw = b.yw;
+    w.resize(nn);
+    arenaResetTable(yw, ncol);
+    for (int k = 0; k < ncol; ++k)
+      yw[k].resize(nn);
+    for (int i = 0; i < nn; ++i) {
+      w[i] = wI + i*wS;
+      for (int k = 0; k < ncol; ++k)
+        yw[k][i] = res[size_t(i)*ncol + k];
+    }
+    packRecord(file_name, w, yw, false, b.rec);
+    pack_pos = pack.append(b.rec);
+    return ncol;
+  }
+  writeGrid(file_name, res, ncol, wI, wS, nn, b.text);
+  return ncol;
+}
 
-  int n = y.size();
-  double y1 = (y[1] - y[0])/(x[1] - x[0]);
-  double yn = (y[n-1] - y[n-2])/(x[n-1] - x[n-2]);
-  y2.resize(n);
-  ml_spline(x, y, y1, yn, y2);
 
+/*----------------------------------------------------------------------------------------------------------------------
+  Stack the fits of all files. Files are split in contiguous blocks stacked in parallel, the partial stacks are merged
+  in order of the blocks. Returns the number of value columns of the stack.
+----------------------------------------------------------------------------------------------------------------------*/
+int stackScans(const vector<string> &files, ThreadPool &pool, const FFTResponse &resp)
+{
   int nn = int((wF - wI)/wS) + 1;
-  string file_name = "clean-" + data_file_name;
-  ofstream fout; fout.open(file_name.c_str(), ios::out);
+  int nfile = files.size();
+  int npart = max(1, min(nfile, pool.size()));
+  vector<WelfordStack> part(npart, WelfordStack(nn));
+  pool.parallelFor(npart, [&](int p) {
+    for (int i = p*nfile/npart; i < (p + 1)*nfile/npart; ++i) {
+      int ncol = fitScan(files[i], pool, resp);
+      if (!part[p].add(workerArena<WorkBuffers>().res.data(), ncol))
+        cout << "File " << files[i] << " differs in number of columns from the stack, skipped!\n";
+#ifdef COUNT_ALLOC
+      printf("%s : %ld allocations so far\n", files[i].c_str(), allocCount());
+#endif
+    }
+  });
+  WelfordStack &st = part[0];
+  for (int p = 1; p < npart; ++p)
+    if (!st.merge(part[p]))
+      cout << "Block " << p << " differs in number of columns from the stack, skipped!\n";
+
+  int ncol = st.getColumnNum();
+  string text;
+  char buf[32];
   for (int i = 0; i < nn; ++i) {
-    double w = wI + i*wS;
-    fout << w << " " << ml_splint(x, y, y2, w) << "\n";
+    snprintf(buf, sizeof(buf), "%g", wI + i*wS);
+    text += buf;
+    for (int k = 0; k < ncol; ++k) {
+      snprintf(buf, sizeof(buf), " %g %g", st.getMean(i, k), st.getStdErr(i, k));
+      text += buf;
+    }
+    text += '\n';
   }
-  fout.close();
+  if (!arenaWriteFile(stack_name, text))
+    cout << "Can not write file " << stack_name << "!\n";
+  return ncol;
 }
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+  Sweep of the settings over all files. Each file is read once at full resolution into the thread's buffers, despiked
+  and its adaptive knots selected; the settings of the file are fitted in parallel from copies of these data. The sums
+  of squared residuals and their numbers are set for the setting s and file f at s*nfile + f. "resp" holds the
+  responses of the steps of sweep_step.
+----------------------------------------------------------------------------------------------------------------------*/
+void sweepScans(const vector<string> &files, ThreadPool &pool, const vector<FFTResponse> &resp, vector<double> &sum,
+  vector<long> &count)
+{
+  int nfile = files.size();
+  int nset = sweep_rare_num*sweep_step_num;
+  sum.assign(size_t(nset)*nfile, 0.0);
+  count.assign(size_t(nset)*nfile, 0);
+  pool.parallelFor(nfile, [&](int f) {
+    WorkBuffers &fb = workerArena<WorkBuffers>();
+    const vector<double> &fx = fb.fx;
+    const vector<vector<double> > &fy = fb.fy;
+    read_rare(files[f], fb.fx, fb.fy, 1);
+    if (hampel_half > 0)
+      pool.parallelFor(fy.size(), [&](int k) { hampelFilter(fb.fy[k], hampel_half, hampel_nsigma); });
+    if (knot_mode == 1)
+      selectKnots(fx, fy, knot_nsigma, knot_rel_tol, knot_max_step, fb.idx);
+
+    pool.parallelFor(nset, [&](int s) {
+      WorkBuffers &b = workerArena<WorkBuffers>();
+      int i_rare = sweep_rare[s/sweep_step_num];
+      int i_step = s%sweep_step_num;
+      double step = sweep_step[i_step];
+      b.x = fx;
+      b.y = fy;
+      if (knot_mode == 1)
+        keepKnots(b.x, b.y, fb.idx);
+      else
+        decimate(b.x, b.y, i_rare);
+      int nn = int((wF - wI)/step) + 1;
+      int ncol = fy.size();
+      fitGrid(b.x, b.y, b.y2, b.ua, wI, step, nn, eval_chunk, (resp_mode != 0) ? &resp[i_step] : NULL, b.res, pool);
+      size_t is = size_t(s)*nfile + f;
+      sum[is] = gridResidual(fx, fy, wI, step, nn, b.res.data(), count[is]);
+
+      char buf[64];
+      snprintf(buf, sizeof(buf), "sweep-%d-%g-", i_rare, step);
+      string &file_name = b.name;
+      file_name.assign(buf);
+      file_name += files[f];
+      writeGrid(file_name, b.res, ncol, wI, step, nn, b.text);
+    });
+#ifdef COUNT_ALLOC
+    printf("%s : %ld allocations so far\n", files[f].c_str(), allocCount());
+#endif
+  });
+}
+
 
 /***********************************************************************************************************************
   Main program.
 ***********************************************************************************************************************/
 int main(int argc, char **argv)
 {
-  string plt_name = "plot_noisy_clean.plt";
+  ThreadPool pool(thread_num);
+  PackWriter pack;
+  if ( (out_mode == 1) && !pack.open(pack_name) ) {
+    cout << "Can not open pack " << pack_name << "!\n";
+    exit(0);
+  }
+  int nn = int((wF - wI)/wS) + 1;
+  FFTResponse resp;
+  if (resp_mode != 0)
+    resp.init(nn, wS, resp_shape, resp_fwhm, resp_mode, resp_reg);
+  vector<string> files(file_name, file_name + file_num);
+  if (argc > 1) files.assign(argv + 1, argv + argc);
+  int nfile = files.size();
+  int stack_col = 0;
+  vector<int> col_num(nfile);
+  vector<uint64_t> pack_pos(nfile);
+  if (sweep_mode == 1) {
+    vector<FFTResponse> sweep_resp(sweep_step_num);
+    if (resp_mode != 0)
+      for (int i = 0; i < sweep_step_num; ++i)
+        sweep_resp[i].init(int((wF - wI)/sweep_step[i]) + 1, sweep_step[i], resp_shape, resp_fwhm, resp_mode,
+          resp_reg);
+    vector<double> sum;
+    vector<long> count;
+    sweepScans(files, pool, sweep_resp, sum, count);
+    if (!writeSweepScores(sweep_name, files, sweep_rare, sweep_rare_num, sweep_step, sweep_step_num, sum, count))
+      cout << "Can not write file " << sweep_name << "!\n";
+  } else if (stack_mode == 1)
+    stack_col = stackScans(files, pool, resp);
+  else
+    pool.parallelFor(nfile, [&](int i) {
+      col_num[i] = work(files[i], pool, resp, pack, pack_pos[i]);
+#ifdef COUNT_ALLOC
+      printf("%s : %ld allocations so far\n", files[i].c_str(), allocCount());
+#endif
+    });
+  if (!pack.close())
+    cout << "Can not write pack " << pack_name << "!\n";
+
+  string plot_tag = (argc > 1) ? "-" + files[0] : "";
+  string plt_name = "plot_noisy_clean" + plot_tag + ".plt";
   ofstream fout_p(plt_name.c_str(), ios::out);
   fout_p << "set term png enhanced size 1024,768" << endl;
-  fout_p << "set output \"cleaned.png\"\n";
+  fout_p << "set output \"cleaned" << plot_tag << ".png\"\n";
   // fout_p << "set xrange[375:800]\n";
   fout_p << "plot \\" << endl;
 
-  for (int i = 0; i < file_num; ++i) {
-    work(file_name[i]);
-    fout_p << "\"" << "clean-" + file_name[i] << "\" u 1:2 w l smooth mcsplines";
-    if (i < file_num-1)
+  for (int i = 0; (sweep_mode == 1) && (i < sweep_step_num); ++i) {
+    fout_p << "\"" << sweep_name << "\" every " << sweep_step_num << "::" << i << " u 1:3 w lp t \"step "
+      << sweep_step[i] << "\"";
+    if (i < sweep_step_num-1)
       fout_p << ", \\" << endl;
     else
       fout_p << endl;
   }
+
+  for (int k = 0; k < stack_col; ++k) {
+    fout_p << "\"" << stack_name << "\" u 1:" << 2*k + 2 << ":" << 2*k + 3 << " w yerrorlines";
+    if (k < stack_col-1)
+      fout_p << ", \\" << endl;
+    else
+      fout_p << endl;
+  }
+
+  for (int i = 0; i < nfile; ++i) {
+    int ncol = col_num[i];
+    for (int k = 0; k < ncol; ++k) {
+      if (out_mode == 1)
+        fout_p << packGnuplotSource(pack_name, pack_pos[i], nn, ncol);
+      else
+        fout_p << "\"" << "clean-" + files[i] << "\"";
+      fout_p << " u 1:" << k + 2 << " w l smooth mcsplines";
+      if ((i < nfile-1) || (k < ncol-1))
+        fout_p << ", \\" << endl;
+      else
+        fout_p << endl;
+    }
+  }
   fout_p.close();
 
   string command = "C:\\Soft\\gnuplot\\bin\\gnuplot.exe " + plt_name;
@@ -0,0 +1,373 @@
+/*====================================================================
+
+  PACK OF NAMED DATA ARRAYS:
+
+  One append-only binary file instead of many small output files.
+  Each record keeps the rows "x y1 ... yk" of one output under its
+  name; the offset table at the end of the file lists the records.
+  Reader maps the file to memory and gives the rows in place. Use
+  pack_extract to get the text files back.
+
+  File layout (native byte order, all parts aligned to 8 bytes):
+    header      : "SPKPACK1";
+    records     : PackRecordHeader, name padded with zeros,
+                  npts rows of (ncol + 1) doubles;
+    index       : offsets of the record headers;
+    trailer     : PackTrailer.
+  Appending to a pack drops its index and writes a new one on close.
+  A pack left without index (program stopped) is read by scanning
+  the records.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+
+const char PACK_MAGIC[8] = { 'S', 'P', 'K', 'P', 'A', 'C', 'K', '1' };
+const char PACK_INDEX_MAGIC[8] = { 'S', 'P', 'K', 'I', 'N', 'D', 'X', '1' };
+const char PACK_RECORD_MAGIC[4] = { 'S', 'P', 'K', 'R' };
+
+
+/*--------------------------------------------------------------------
+  Header of a record and trailer of the file.
+--------------------------------------------------------------------*/
+struct PackRecordHeader
+{
+  char magic[4];        // "SPKR".
+  uint32_t name_len;    // Length of the name without padding.
+  uint32_t ncol;        // Number of value columns.
+  uint32_t reserved;
+  uint64_t npts;        // Number of rows.
+};
+
+struct PackTrailer
+{
+  uint64_t index_offset;  // Offset of the index.
+  uint64_t count;         // Number of records.
+  char magic[8];          // "SPKINDX1".
+};
+
+
+/*--------------------------------------------------------------------
+  Size of the name padded to 8 bytes.
+--------------------------------------------------------------------*/
+inline size_t packPadded(size_t n)
+  { return (n + 7) & ~size_t(7); }
+
+
+/*--------------------------------------------------------------------
+  Encode the rows "x y1 ... yk" as a record.
+--------------------------------------------------------------------*/
+inline void packRecord(
+  const std::string &name,                      // Name of the record.
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  bool reverse,                                 // Flag to keep rows in reverse order.
+  std::string &rec)                             // Result record.
+{
+  PackRecordHeader h;
+  memcpy(h.magic, PACK_RECORD_MAGIC, 4);
+  h.name_len = name.size();
+  h.ncol = y.size();
+  h.reserved = 0;
+  h.npts = x.size();
+
+  size_t name_size = packPadded(name.size());
+  size_t nrow = y.size() + 1;
+  rec.assign(sizeof(h) + name_size + x.size()*nrow*sizeof(double), '\0');
+  memcpy(&rec[0], &h, sizeof(h));
+  memcpy(&rec[sizeof(h)], name.data(), name.size());
+  double *p = (double *) &rec[sizeof(h) + name_size];
+  int n = x.size();
+  for (int j = 0; j < n; ++j) {
+    int i = reverse ? n - 1 - j : j;
+    *p++ = x[i];
+    for (int k = 0; k < y.size(); ++k)
+      *p++ = y[k][i];
+  }
+}
+
+
+/*--------------------------------------------------------------------
+  Gnuplot data source for the rows of a record at "data_pos".
+--------------------------------------------------------------------*/
+inline std::string packGnuplotSource(const std::string &pack_name,
+  uint64_t data_pos, int npts, int ncol)
+{
+  char buf[128];
+  snprintf(buf, sizeof(buf), " binary skip=%llu record=%d format=\"",
+    (unsigned long long) data_pos, npts);
+  std::string s = "\"" + pack_name + "\"" + buf;
+  for (int k = 0; k <= ncol; ++k) s += "%double";
+  return s + "\"";
+}
+
+
+class PackWriter
+{
+  private: FILE *fout;
+  private: uint64_t pos;                  // Current end of records.
+  private: std::vector<uint64_t> offset;  // Offsets of record headers.
+  private: std::mutex mtx;
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: PackWriter()
+    { fout = NULL; pos = 0; }
+
+  public: ~PackWriter()
+    { close(); }
+
+
+  /*------------------------------------------------------------------
+    Open the pack. With "append" set the records of an existing pack
+    are kept, otherwise the file is created anew.
+  ------------------------------------------------------------------*/
+  public: bool open(const std::string &name, bool append = false)
+  {
+    close();
+    offset.clear();
+    struct stat st;
+    if ( append && (stat(name.c_str(), &st) == 0) ) {
+      if (!readIndex(name)) return false;
+      if (truncate(name.c_str(), pos) != 0) return false;
+      fout = fopen(name.c_str(), "r+b");
+      if (fout == NULL) return false;
+      fseeko(fout, pos, SEEK_SET);
+    } else {
+      fout = fopen(name.c_str(), "wb");
+      if (fout == NULL) return false;
+      fwrite(PACK_MAGIC, 1, 8, fout);
+      pos = 8;
+    }
+    setvbuf(fout, NULL, _IOFBF, 1 << 20);
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Append a record made by packRecord. Returns the offset of its
+    rows in the file, may be called from several threads.
+  ------------------------------------------------------------------*/
+  public: uint64_t append(const std::string &rec)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    const PackRecordHeader *h = (const PackRecordHeader *) rec.data();
+    uint64_t data_pos = pos + sizeof(PackRecordHeader) + packPadded(h->name_len);
+    fwrite(rec.data(), 1, rec.size(), fout);
+    offset.push_back(pos);
+    pos += rec.size();
+    return data_pos;
+  }
+
+
+  /*------------------------------------------------------------------
+    Write the index and close the pack. Returns false on write error.
+  ------------------------------------------------------------------*/
+  public: bool close()
+  {
+    if (fout == NULL) return true;
+    PackTrailer t;
+    t.index_offset = pos;
+    t.count = offset.size();
+    memcpy(t.magic, PACK_INDEX_MAGIC, 8);
+    if (!offset.empty())
+      fwrite(&offset[0], sizeof(uint64_t), offset.size(), fout);
+    fwrite(&t, sizeof(t), 1, fout);
+    bool ok = !ferror(fout);
+    ok = (fclose(fout) == 0) && ok;
+    fout = NULL;
+    return ok;
+  }
+
+
+  /*------------------------------------------------------------------
+    Offsets of the records of an existing pack, "pos" is set to the
+    end of its records.
+  ------------------------------------------------------------------*/
+  private: bool readIndex(const std::string &name);
+};
+
+
+class PackReader
+{
+  private: const char *base;              // Mapped file.
+  private: size_t size;
+  private: std::vector<uint64_t> offset;  // Offsets of record headers.
+  private: uint64_t end;                  // End of records.
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: PackReader()
+    { base = NULL; size = 0; end = 0; }
+
+  public: ~PackReader()
+    { close(); }
+
+
+  /*------------------------------------------------------------------
+    Map the pack to memory. Returns false if it is not a pack.
+  ------------------------------------------------------------------*/
+  public: bool open(const std::string &name)
+  {
+    close();
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if ( (fstat(fd, &st) != 0) || (st.st_size < 8) ) { ::close(fd); return false; }
+    size = st.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) { size = 0; return false; }
+    base = (const char *) p;
+    madvise(p, size, MADV_SEQUENTIAL);
+    if (memcmp(base, PACK_MAGIC, 8) != 0) { close(); return false; }
+
+    // Index from the trailer if all its records are whole, or by
+    // scanning the records.
+    bool indexed = false;
+    if (size >= 8 + sizeof(PackTrailer)) {
+      const PackTrailer *t = (const PackTrailer *) (base + size - sizeof(PackTrailer));
+      uint64_t idx_end = size - sizeof(PackTrailer);
+      if ( (memcmp(t->magic, PACK_INDEX_MAGIC, 8) == 0) && (t->index_offset >= 8)
+        && (t->index_offset % 8 == 0) && (t->index_offset <= idx_end)
+        && ((idx_end - t->index_offset) % sizeof(uint64_t) == 0)
+        && (t->count == (idx_end - t->index_offset)/sizeof(uint64_t)) ) {
+        const uint64_t *idx = (const uint64_t *) (base + t->index_offset);
+        indexed = true;
+        for (uint64_t r = 0; indexed && (r < t->count); ++r)
+          indexed = (recordEnd(idx[r], t->index_offset) != 0);
+        if (indexed) {
+          offset.assign(idx, idx + t->count);
+          end = t->index_offset;
+        }
+      }
+    }
+    if (!indexed) {
+      end = 8;
+      for (uint64_t rec_end; (rec_end = recordEnd(end, size)) != 0; end = rec_end)
+        offset.push_back(end);
+    }
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Unmap the pack.
+  ------------------------------------------------------------------*/
+  public: void close()
+  {
+    if (base != NULL) munmap((void *) base, size);
+    base = NULL; size = 0; end = 0;
+    offset.clear();
+  }
+
+
+  /*------------------------------------------------------------------
+    Number of records, end of records, offset of record "r".
+  ------------------------------------------------------------------*/
+  public: int getNum() { return offset.size(); }
+  public: uint64_t getEnd() { return end; }
+  public: uint64_t getOffset(int r) { return offset[r]; }
+
+
+  /*------------------------------------------------------------------
+    Record "r": name, number of rows and value columns, rows
+    "x y1 ... yk" in place, offset of rows in the file.
+  ------------------------------------------------------------------*/
+  public: std::string getName(int r)
+    { return std::string(base + offset[r] + sizeof(PackRecordHeader), header(r)->name_len); }
+
+  public: int getPointNum(int r) { return header(r)->npts; }
+  public: int getColNum(int r) { return header(r)->ncol; }
+
+  public: const double *getRows(int r)
+    { return (const double *) (base + getDataOffset(r)); }
+
+  public: uint64_t getDataOffset(int r)
+    { return offset[r] + sizeof(PackRecordHeader) + packPadded(header(r)->name_len); }
+
+
+  /*------------------------------------------------------------------
+    Index of the last record with the name, -1 if there is none.
+  ------------------------------------------------------------------*/
+  public: int find(const std::string &name)
+  {
+    for (int r = offset.size() - 1; r >= 0; --r)
+      if ( (header(r)->name_len == name.size())
+        && (memcmp(base + offset[r] + sizeof(PackRecordHeader), name.data(), name.size()) == 0) )
+        return r;
+    return -1;
+  }
+
+
+  /*------------------------------------------------------------------
+    Size of the record with the header "h".
+  ------------------------------------------------------------------*/
+  public: static uint64_t recordSize(const PackRecordHeader *h)
+  {
+    return sizeof(PackRecordHeader) + packPadded(h->name_len)
+      + h->npts*(h->ncol + uint64_t(1))*sizeof(double);
+  }
+
+  private: const PackRecordHeader *header(int r)
+    { return (const PackRecordHeader *) (base + offset[r]); }
+
+
+  /*------------------------------------------------------------------
+    End of the record at "at" if it is whole before "limit", 0 if it
+    is not a record or does not fit.
+  ------------------------------------------------------------------*/
+  private: uint64_t recordEnd(uint64_t at, uint64_t limit)
+  {
+    if ( (at < 8) || (at % 8 != 0) || (at > limit) || (limit - at < sizeof(PackRecordHeader)) )
+      return 0;
+    const PackRecordHeader *h = (const PackRecordHeader *) (base + at);
+    if (memcmp(h->magic, PACK_RECORD_MAGIC, 4) != 0) return 0;
+    uint64_t left = limit - at - sizeof(PackRecordHeader);
+    if (packPadded(h->name_len) > left) return 0;
+    left -= packPadded(h->name_len);
+    if (h->npts > left/((h->ncol + uint64_t(1))*sizeof(double))) return 0;
+    return at + recordSize(h);
+  }
+};
+
+
+/*--------------------------------------------------------------------
+  Offsets of the records of an existing pack for appending.
+--------------------------------------------------------------------*/
+inline bool PackWriter::readIndex(const std::string &name)
+{
+  PackReader rd;
+  if (!rd.open(name)) return false;
+  pos = rd.getEnd();
+  for (int r = 0; r < rd.getNum(); ++r)
+    offset.push_back(rd.getOffset(r));
+  return true;
+}
+
+
+#endif // PACK_H
+
+
+//====================================================================
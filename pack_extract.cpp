@@ -0,0 +1,92 @@
+/*====================================================================
+
+  THE PROGRAM to extract text files from a pack (see pack.h).
+
+  Usage:
+    pack_extract <pack>                 : extract all records;
+    pack_extract <pack> <name> ...      : extract the named records;
+    pack_extract -l <pack>              : list the records.
+  Each record is written to the text file "x y1 ... yk" with its
+  name.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <iostream>
+#include "pack.h"
+
+
+/*--------------------------------------------------------------------
+  Write record "r" of the pack to the text file with its name.
+--------------------------------------------------------------------*/
+bool extractRecord(PackReader &pack, int r)
+{
+  std::string name = pack.getName(r);
+  FILE *f = fopen(name.c_str(), "w");
+  if (f == NULL) return false;
+  setvbuf(f, NULL, _IOFBF, 1 << 20);
+  int n = pack.getPointNum(r);
+  int ncol = pack.getColNum(r);
+  const double *p = pack.getRows(r);
+  for (int i = 0; i < n; ++i) {
+    fprintf(f, "%g", *p++);
+    for (int k = 0; k < ncol; ++k)
+      fprintf(f, " %g", *p++);
+    fputc('\n', f);
+  }
+  bool ok = !ferror(f);
+  return (fclose(f) == 0) && ok;
+}
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  bool list = (argc > 1) && (strcmp(argv[1], "-l") == 0);
+  int first = list ? 2 : 1;
+  if (argc <= first) {
+    std::cout << "Usage: pack_extract [-l] <pack> [<name> ...]\n";
+    return 0;
+  }
+
+  PackReader pack;
+  if (!pack.open(argv[first])) {
+    std::cout << "File " << argv[first] << " is not a pack!\n";
+    return 0;
+  }
+
+  if (list) {
+    for (int r = 0; r < pack.getNum(); ++r)
+      std::cout << pack.getName(r) << "  " << pack.getPointNum(r) << " x "
+        << pack.getColNum(r) + 1 << "\n";
+    return 0;
+  }
+
+  if (argc == first + 1) {
+    for (int r = 0; r < pack.getNum(); ++r)
+      if (!extractRecord(pack, r))
+        std::cout << "Can not write file " << pack.getName(r) << "!\n";
+    return 0;
+  }
+
+  for (int a = first + 1; a < argc; ++a) {
+    int r = pack.find(argv[a]);
+    if (r < 0)
+      std::cout << "No record " << argv[a] << " in the pack!\n";
+    else if (!extractRecord(pack, r))
+      std::cout << "Can not write file " << argv[a] << "!\n";
+  }
+  return 0;
+}
+
+
+//====================================================================
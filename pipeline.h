@@ -0,0 +1,338 @@
+/*====================================================================
+
+  OVERLAPPED READ / COMPUTE / WRITE PIPELINE for batch tools.
+
+  Three stages run concurrently on a list of files: the reader loads
+  file i+1 (and further ahead) while file i is computed and file i-1
+  is written. Stages are joined by bounded queues, so at most "depth"
+  files wait between two stages. The compute stage may run on several
+  threads.
+
+  With PIPELINE_USE_IO_URING defined (link with -luring) the reader
+  keeps up to "depth" whole-file reads in flight through io_uring,
+  which hides the latency of network storage; otherwise the reader
+  thread reads files one by one with pread(). Compressed files are
+  decompressed by the reader stage (see zstream.h). With a pack
+  given, the writer appends the records made by the compute stage to
+  it instead of writing files (see pack.h).
+
+  Queues are rings of items swapped in and out, so the name and data
+  buffers of the files circulate between the stages and are reused;
+  with the compute stage drawing its buffers from worker arenas (see
+  arena.h) they are not allocated again after the first files. What
+  remains are copies of long file names, a few per file whatever its
+  size, and the state of the zlib and zstd decompressors of each
+  compressed file, which they allocate with malloc (not counted by
+  COUNT_ALLOC).
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "arena.h"
+#include "zstream.h"
+#include "pack.h"
+#ifdef PIPELINE_USE_IO_URING
+#include <liburing.h>
+#endif
+
+
+/*--------------------------------------------------------------------
+  File passed through the pipeline.
+--------------------------------------------------------------------*/
+struct PipelineJob
+{
+  std::string name;   // Input name, set to output name by compute stage.
+  std::string data;   // Input contents, set to output contents.
+  bool ok;            // False: file not read or nothing to write.
+};
+
+
+/*--------------------------------------------------------------------
+  Queue of limited capacity between two stages. Pop returns false
+  when the queue is closed and empty. Items are swapped with the
+  slots of a ring, so the caller gets back the buffers of an item
+  taken earlier.
+--------------------------------------------------------------------*/
+template <class T> class BoundedQueue
+{
+  private: std::vector<T> slots;
+  private: size_t head, count;
+  private: bool closed;
+  private: std::mutex mtx;
+  private: std::condition_variable cv_push, cv_pop;
+
+  public: BoundedQueue(size_t cap)
+    { slots.resize((cap > 0) ? cap : 1); head = 0; count = 0; closed = false; }
+
+  public: void push(T &item)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (count >= slots.size()) cv_push.wait(lock);
+    slots[(head + count)%slots.size()].swap(item);
+    ++count;
+    cv_pop.notify_one();
+  }
+
+  public: bool pop(T &item)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while ( (count == 0) && !closed ) cv_pop.wait(lock);
+    if (count == 0) return false;
+    item.swap(slots[head]);
+    head = (head + 1)%slots.size();
+    --count;
+    cv_push.notify_one();
+    return true;
+  }
+
+  public: void close()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    cv_pop.notify_all();
+  }
+};
+
+
+/*--------------------------------------------------------------------
+  Pipeline job with swap for the queues.
+--------------------------------------------------------------------*/
+struct PipelineItem : public PipelineJob
+{
+  PipelineItem() { ok = false; }
+  void swap(PipelineItem &o)
+    { name.swap(o.name); data.swap(o.data); std::swap(ok, o.ok); }
+};
+
+
+/*--------------------------------------------------------------------
+  Read the whole file into "data". Returns false if the file can not
+  be read or decompressed, the message is set to "err".
+--------------------------------------------------------------------*/
+inline bool pipelineReadFile(const std::string &name, std::string &data, std::string &err)
+{
+  data.clear();
+  err.clear();
+  int fd = open(name.c_str(), O_RDONLY);
+  if (fd < 0) { err = "File " + name + " not found!"; return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    err = "Read error in file " + name + "!";
+    return false;
+  }
+  data.resize(st.st_size);
+  size_t got = 0;
+  while (got < data.size()) {
+    ssize_t r = pread(fd, &data[got], data.size() - got, got);
+    if (r < 0) {
+      close(fd);
+      err = "Read error in file " + name + "!";
+      return false;
+    }
+    if (r == 0) break;
+    got += r;
+  }
+  close(fd);
+  data.resize(got);
+  return zstreamDecode(name, data, err);
+}
+
+
+/*--------------------------------------------------------------------
+  Write "data" to the file.
+--------------------------------------------------------------------*/
+inline bool pipelineWriteFile(const std::string &name, const std::string &data)
+{
+  return arenaWriteFile(name, data);
+}
+
+
+#ifdef PIPELINE_USE_IO_URING
+/*--------------------------------------------------------------------
+  Reader stage on io_uring: up to "depth" files are read at once,
+  they are passed on in the order of the list.
+--------------------------------------------------------------------*/
+inline void pipelineReadStage(const std::vector<std::string> &files,
+  BoundedQueue<PipelineItem> &out, int depth)
+{
+  struct Pending { PipelineItem item; int fd; size_t got; bool done; };
+  struct io_uring ring;
+  std::string err;
+  if (io_uring_queue_init(depth, &ring, 0) != 0) {
+    for (size_t i = 0; i < files.size(); ++i) {
+      PipelineItem item;
+      item.name = files[i];
+      item.ok = pipelineReadFile(files[i], item.data, err);
+      if (!item.ok) printf("%s\n", err.c_str());
+      out.push(item);
+    }
+    return;
+  }
+
+  std::deque<Pending> pending;
+  size_t next = 0;
+  int in_flight = 0;
+  while ( (next < files.size()) || !pending.empty() ) {
+
+    // Open further files and submit their reads.
+    while ( (next < files.size()) && (pending.size() < size_t(depth)) ) {
+      pending.push_back(Pending());
+      Pending &p = pending.back();
+      p.item.name = files[next++];
+      p.got = 0;
+      p.done = true;
+      p.fd = open(p.item.name.c_str(), O_RDONLY);
+      struct stat st;
+      if ( (p.fd < 0) || (fstat(p.fd, &st) != 0) ) {
+        printf("File %s not found!\n", p.item.name.c_str());
+        continue;
+      }
+      p.item.data.resize(st.st_size);
+      p.item.ok = true;
+      if (st.st_size == 0) continue;
+      p.done = false;
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+      io_uring_prep_read(sqe, p.fd, &p.item.data[0], st.st_size, 0);
+      io_uring_sqe_set_data(sqe, &p);
+      ++in_flight;
+    }
+    io_uring_submit(&ring);
+
+    // Collect completions, resubmit short reads.
+    if (in_flight > 0) {
+      struct io_uring_cqe *cqe;
+      if (io_uring_wait_cqe(&ring, &cqe) == 0) {
+        Pending &p = *static_cast<Pending *>(io_uring_cqe_get_data(cqe));
+        int res = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+        --in_flight;
+        if (res > 0) p.got += res;
+        if ( (res > 0) && (p.got < p.item.data.size()) ) {
+          struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+          io_uring_prep_read(sqe, p.fd, &p.item.data[p.got],
+            p.item.data.size() - p.got, p.got);
+          io_uring_sqe_set_data(sqe, &p);
+          ++in_flight;
+        } else {
+          p.item.data.resize(p.got);
+          if (res < 0) {
+            printf("Read error in file %s!\n", p.item.name.c_str());
+            p.item.ok = false;
+          } else if (!zstreamDecode(p.item.name, p.item.data, err)) {
+            printf("%s\n", err.c_str());
+            p.item.ok = false;
+          }
+          p.done = true;
+        }
+      }
+    }
+
+    // Pass on the finished files in order.
+    while (!pending.empty() && pending.front().done) {
+      if (pending.front().fd >= 0) close(pending.front().fd);
+      out.push(pending.front().item);
+      pending.pop_front();
+    }
+  }
+  io_uring_queue_exit(&ring);
+}
+#else
+/*--------------------------------------------------------------------
+  Reader stage on a plain thread. Files are read one at a time; the
+  read-ahead is bounded by the capacity of the queue "out", so the
+  depth is not used.
+--------------------------------------------------------------------*/
+inline void pipelineReadStage(const std::vector<std::string> &files,
+  BoundedQueue<PipelineItem> &out, int /* depth */)
+{
+  PipelineItem item;    // Gets back buffers of written files.
+  std::string err;
+  for (size_t i = 0; i < files.size(); ++i) {
+    item.name = files[i];
+    item.ok = pipelineReadFile(files[i], item.data, err);
+    if (!item.ok) printf("%s\n", err.c_str());
+    out.push(item);
+  }
+}
+#endif
+
+
+/*--------------------------------------------------------------------
+  Run the pipeline over the files. "compute" replaces the job name
+  and data by the output ones, or clears "ok" to skip writing. With
+  "pack" given the output data is a record made by packRecord. With
+  one compute thread "compute" is called on the calling thread in the
+  order of the list; with several ones it must be thread safe, and
+  files are written in the order of completion.
+--------------------------------------------------------------------*/
+inline void runPipeline(
+  const std::vector<std::string> &files,                // Input files.
+  const std::function<void(PipelineJob &)> &compute,    // Compute stage.
+  int depth = 4,                                        // Queue capacity.
+  PackWriter *pack = NULL,                              // Pack for output, NULL for files.
+  int nthread = 1)                                      // Compute threads, 0 for one per core.
+{
+  BoundedQueue<PipelineItem> q_read(depth), q_write(depth);
+
+  std::thread reader([&]() {
+    pipelineReadStage(files, q_read, depth);
+    q_read.close();
+  });
+
+  std::thread writer([&]() {
+    PipelineItem item;
+    while (q_write.pop(item)) {
+      if (!item.ok) continue;
+      if (pack != NULL)
+        pack->append(item.data);
+      else if (!pipelineWriteFile(item.name, item.data))
+        printf("Can not write file %s!\n", item.name.c_str());
+    }
+  });
+
+  auto computeLoop = [&]() {
+    PipelineItem item;
+    while (q_read.pop(item)) {
+      if (item.ok) compute(item);
+#ifdef COUNT_ALLOC
+      printf("%s : %ld allocations so far\n", item.name.c_str(), allocCount());
+#endif
+      q_write.push(item);
+    }
+  };
+  if (nthread <= 0) nthread = std::thread::hardware_concurrency();
+  std::vector<std::thread> helpers;
+  for (int i = 1; i < nthread; ++i)
+    helpers.push_back(std::thread(computeLoop));
+  computeLoop();
+  for (int i = 0; i < helpers.size(); ++i)
+    helpers[i].join();
+  q_write.close();
+
+  reader.join();
+  writer.join();
+}
+
+
+#endif // PIPELINE_H
+
+
+//====================================================================
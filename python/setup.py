@@ -0,0 +1,31 @@
+#=====================================================================
+#
+#  Build of the Python bindings (module "spectra", see spectra.cpp):
+#
+#    python3 setup.py build_ext --inplace
+#
+#  Compressed data files are read with SPECTRA_ZLIB=1 and/or
+#  SPECTRA_ZSTD=1 set in the environment (see zstream.h).
+#
+#=====================================================================
+
+import os
+from setuptools import setup, Extension
+
+here = os.path.dirname(os.path.abspath(__file__))
+macros, libs = [], []
+if os.environ.get('SPECTRA_ZLIB') == '1':
+    macros.append(('HAVE_ZLIB', None)); libs.append('z')
+if os.environ.get('SPECTRA_ZSTD') == '1':
+    macros.append(('HAVE_ZSTD', None)); libs.append('zstd')
+
+setup(
+    name='spectra',
+    version='1.0',
+    ext_modules=[Extension(
+        'spectra',
+        sources=['spectra.cpp'],
+        include_dirs=[os.path.dirname(here)],
+        define_macros=macros,
+        libraries=libs,
+        extra_compile_args=['-std=c++11', '-O2', '-pthread'])])
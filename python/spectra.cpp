@@ -0,0 +1,747 @@
+/*====================================================================
+
+  PYTHON BINDINGS OF THE DATA READER, THE SPLINE AND TABLE3D:
+
+  Module "spectra" (build: python3 setup.py build_ext --inplace).
+
+    x, y = spectra.read(name, step = 1)
+      Data file "x y1 ... yk" (plain or compressed, see zstream.h),
+      every step-th line; x has shape (n,), y has shape (n, k).
+
+    s = spectra.Spline(x, y)
+      Cubic spline through the points (see spline.h), y of shape (n,)
+      or (n, k); x must increase.
+      s(w), s.deriv(w, order = 1) - values and derivatives at points w;
+      s.integral(lo, hi), s.moments(lo, hi) - integrals of y and of
+      x^p y, p = 0, 1, 2, over [lo, hi].
+
+    t = spectra.Table3D(name, order = 0)
+      Table of the file "x y z1 ... zk" (see table3d.h); t.x, t.y and
+      t.z of shape (nx, ny, k) are read-only views of the table.
+      t.interp(x, y, channel = 0) - bilinear interpolation at points,
+      channel = -1 for all channels; t.getZ(i, j, channel = 0).
+
+  Arrays are spectra.Array objects exporting their memory through the
+  buffer protocol: numpy.asarray(a) and memoryview(a) share it with
+  no copy, views of a table keep the table alive. Arguments may be
+  any buffers of doubles (numpy arrays, array('d'), Array), strided
+  ones included; they are read in place. Reading, loading, fitting and
+  evaluation release the GIL, so Python threads run them in parallel
+  over files. A missing, unreadable or damaged data file raises
+  OSError, a table file of the wrong format ValueError.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "zstream.h"
+#include "spline.h"
+#include "table3d/table3d.h"
+
+
+/*--------------------------------------------------------------------
+  Array of doubles with up to 3 dimensions. Either owns its values
+  or views the memory of the "base" object. Strides are in bytes.
+--------------------------------------------------------------------*/
+struct ArrayObject
+{
+  PyObject_HEAD
+  vector<double> *own;        // Owned values, NULL for a view.
+  PyObject *base;             // Owner of the viewed values.
+  double *data;               // First element.
+  int ndim;                   // Number of dimensions.
+  Py_ssize_t shape[3];        // Sizes along dimensions.
+  Py_ssize_t strides[3];      // Strides along dimensions.
+  int readonly;               // Flag of read-only values.
+};
+
+static PyTypeObject ArrayType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+
+/*--------------------------------------------------------------------
+  New array owning "own" (taken over, may be NULL for a new one) or
+  viewing the values of "base". Strides are given in elements, zero
+  ones mean C order.
+--------------------------------------------------------------------*/
+static ArrayObject *newArray(int ndim, const Py_ssize_t *shape, vector<double> *own = NULL,
+  PyObject *base = NULL, double *data = NULL, const Py_ssize_t *strides = NULL, int readonly = 0)
+{
+  ArrayObject *a = PyObject_New(ArrayObject, &ArrayType);
+  if (a == NULL) { delete own; return NULL; }
+  size_t size = 1;
+  for (int d = 0; d < ndim; ++d) size *= shape[d];
+  if ( (base == NULL) && (own == NULL) ) own = new vector<double>(size);
+  a->own = own;
+  a->base = base;
+  Py_XINCREF(base);
+  a->data = (own != NULL) ? own->data() : data;
+  a->ndim = ndim;
+  a->readonly = readonly;
+  Py_ssize_t step = 1;
+  for (int d = ndim - 1; d >= 0; --d) {
+    a->shape[d] = shape[d];
+    a->strides[d] = sizeof(double)*((strides != NULL) ? strides[d] : step);
+    step *= shape[d];
+  }
+  return a;
+}
+
+static void arrayDealloc(ArrayObject *a)
+{
+  delete a->own;
+  Py_XDECREF(a->base);
+  PyObject_Del(a);
+}
+
+
+/*--------------------------------------------------------------------
+  Buffer protocol of the array.
+--------------------------------------------------------------------*/
+static int arrayGetBuffer(ArrayObject *a, Py_buffer *view, int flags)
+{
+  if ( (flags & PyBUF_WRITABLE) && a->readonly ) {
+    PyErr_SetString(PyExc_BufferError, "array is read-only");
+    return -1;
+  }
+  bool contiguous = true;
+  Py_ssize_t step = sizeof(double), len = sizeof(double);
+  for (int d = a->ndim - 1; d >= 0; --d) {
+    if ( (a->shape[d] > 1) && (a->strides[d] != step) ) contiguous = false;
+    step *= a->shape[d];
+    len *= a->shape[d];
+  }
+  if ( !contiguous && ( ((flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+    || ((flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS)
+    || ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS)
+    || ((flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS) ) ) {
+    PyErr_SetString(PyExc_BufferError, "array is not contiguous");
+    return -1;
+  }
+  view->obj = (PyObject *) a;
+  Py_INCREF(a);
+  view->buf = a->data;
+  view->len = len;
+  view->itemsize = sizeof(double);
+  view->readonly = a->readonly;
+  view->format = (flags & PyBUF_FORMAT) ? (char *) "d" : NULL;
+  view->ndim = a->ndim;
+  view->shape = ((flags & PyBUF_ND) == PyBUF_ND) ? a->shape : NULL;
+  view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? a->strides : NULL;
+  view->suboffsets = NULL;
+  view->internal = NULL;
+  return 0;
+}
+
+static PyBufferProcs arrayBuffer;
+
+
+/*--------------------------------------------------------------------
+  Shape of the array and its length along the 1st dimension.
+--------------------------------------------------------------------*/
+static PyObject *arrayShape(ArrayObject *a, void *)
+{
+  PyObject *t = PyTuple_New(a->ndim);
+  if (t == NULL) return NULL;
+  for (int d = 0; d < a->ndim; ++d)
+    PyTuple_SET_ITEM(t, d, PyLong_FromSsize_t(a->shape[d]));
+  return t;
+}
+
+static Py_ssize_t arrayLength(ArrayObject *a)
+  { return (a->ndim > 0) ? a->shape[0] : 0; }
+
+static PyGetSetDef arrayGetSet[] = {
+  { (char *) "shape", (getter) arrayShape, NULL, (char *) "Sizes along dimensions.", NULL },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PySequenceMethods arraySequence;
+
+
+/*--------------------------------------------------------------------
+  Buffer of doubles given as an argument, read in place through its
+  strides. Released with the object.
+--------------------------------------------------------------------*/
+class DoubleArg
+{
+  private: Py_buffer view;
+  private: bool held;
+
+  public: DoubleArg() : held(false) {}
+  public: ~DoubleArg() { if (held) PyBuffer_Release(&view); }
+
+  // Get the buffer of "ndim_min" ... "ndim_max" dimensions, false
+  // with Python error set on failure.
+  public: bool get(PyObject *o, const char *what, int ndim_min = 1, int ndim_max = 1)
+  {
+    if (PyObject_GetBuffer(o, &view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) return false;
+    held = true;
+    const char *f = (view.format != NULL) ? view.format : "B";
+    if ( (f[0] != '\0') && (strchr("@=<", f[0]) != NULL) ) ++f;
+    if ( (strcmp(f, "d") != 0) || (view.itemsize != sizeof(double)) ) {
+      PyErr_Format(PyExc_TypeError, "%s must be a buffer of doubles", what);
+      return false;
+    }
+    if ( (view.ndim < ndim_min) || (view.ndim > ndim_max) ) {
+      PyErr_Format(PyExc_ValueError, "%s must have %d to %d dimensions", what, ndim_min, ndim_max);
+      return false;
+    }
+    return true;
+  }
+
+  public: int ndim() const { return view.ndim; }
+  public: Py_ssize_t size(int d = 0) const { return (d < view.ndim) ? view.shape[d] : 1; }
+
+  public: double at(Py_ssize_t i) const
+    { return *(const double *) ((const char *) view.buf + i*view.strides[0]); }
+
+  public: double at(Py_ssize_t i, Py_ssize_t k) const
+  {
+    const char *p = (const char *) view.buf + i*view.strides[0];
+    if (view.ndim > 1) p += k*view.strides[1];
+    return *(const double *) p;
+  }
+};
+
+
+/*--------------------------------------------------------------------
+  spectra.read(name, step = 1): columns of the data file. Lines with
+  fewer numbers than the first data line are skipped. Values are
+  kept row by row in one block; x and y are views of it.
+--------------------------------------------------------------------*/
+static PyObject *spectraRead(PyObject *, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "name", "step", NULL };
+  const char *name;
+  int step = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|i", (char **) kwlist, &name, &step))
+    return NULL;
+  if (step < 1) step = 1;
+
+  vector<double> *v = new vector<double>;
+  int ncol = -1;        // Number of columns after x.
+  string err;           // Error of the file.
+  Py_BEGIN_ALLOW_THREADS
+  DataInputStream fin(name);
+  if (!fin) {
+    err = fin.error();
+  } else {
+    string line;
+    vector<double> row;
+    long nline = 0;
+    while (getline(fin, line)) {
+      const char *p = line.c_str();
+      char *end;
+      row.clear();
+      for (double t = strtod(p, &end); end != p; t = strtod(p, &end)) {
+        row.push_back(t);
+        p = end;
+      }
+      if (row.size() < 2) continue;
+      if (ncol < 0) ncol = row.size() - 1;
+      if (row.size() < size_t(ncol + 1)) continue;
+      if ((nline++)%step != 0) continue;
+      v->insert(v->end(), row.begin(), row.begin() + ncol + 1);
+    }
+    err = fin.error();
+    fin.close();
+  }
+  Py_END_ALLOW_THREADS
+  if (!err.empty()) {
+    delete v;
+    PyErr_SetString(PyExc_OSError, err.c_str());
+    return NULL;
+  }
+  if (ncol < 0) ncol = 0;
+
+  Py_ssize_t n = v->size()/(ncol + 1);
+  Py_ssize_t block_shape[2] = { n, ncol + 1 };
+  ArrayObject *block = newArray(2, block_shape, v);
+  if (block == NULL) return NULL;
+  double *p = block->data;
+  Py_ssize_t x_shape[1] = { n }, x_strides[1] = { ncol + 1 };
+  Py_ssize_t y_shape[2] = { n, ncol }, y_strides[2] = { ncol + 1, 1 };
+  PyObject *x = (PyObject *) newArray(1, x_shape, NULL, (PyObject *) block, p, x_strides);
+  PyObject *y = (PyObject *) newArray(2, y_shape, NULL, (PyObject *) block, p + 1, y_strides);
+  Py_DECREF(block);
+  if ( (x == NULL) || (y == NULL) ) { Py_XDECREF(x); Py_XDECREF(y); return NULL; }
+  return Py_BuildValue("(NN)", x, y);
+}
+
+
+/*--------------------------------------------------------------------
+  Spline object: the arguments, values and second derivatives of the
+  columns as the tools keep them.
+--------------------------------------------------------------------*/
+struct SplineObject
+{
+  PyObject_HEAD
+  vector<double> *x;            // Arguments.
+  vector<vector<double> > *y;   // Values of the columns.
+  vector<vector<double> > *y2;  // Second derivatives of the columns.
+  UniformAxis ua;               // Uniform axis of the arguments, if any.
+  int flat;                     // Flag of the 1D values.
+};
+
+static PyTypeObject SplineType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+
+static int splineInit(SplineObject *s, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "x", "y", NULL };
+  PyObject *ox, *oy;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO", (char **) kwlist, &ox, &oy))
+    return -1;
+  if (!s->x->empty()) {
+    PyErr_SetString(PyExc_RuntimeError, "spline is fitted already");
+    return -1;
+  }
+  DoubleArg ax, ay;
+  if ( !ax.get(ox, "x") || !ay.get(oy, "y", 1, 2) ) return -1;
+  int n = ax.size();
+  if (ay.size(0) != n) {
+    PyErr_SetString(PyExc_ValueError, "x and y differ in length");
+    return -1;
+  }
+  if (n < 2) {
+    PyErr_SetString(PyExc_ValueError, "at least two points are needed");
+    return -1;
+  }
+  for (int i = 1; i < n; ++i)
+    if (!(ax.at(i) > ax.at(i - 1))) {
+      PyErr_SetString(PyExc_ValueError, "x must increase");
+      return -1;
+    }
+
+  // Fitted aside and taken over with the GIL held: other threads may
+  // use the spline object meanwhile.
+  int ncol = ay.size(1);
+  vector<double> x;
+  vector<vector<double> > y, y2;
+  UniformAxis ua;
+  Py_BEGIN_ALLOW_THREADS
+  x.resize(n);
+  for (int i = 0; i < n; ++i) x[i] = ax.at(i);
+  y.resize(ncol);
+  y2.resize(ncol);
+  for (int k = 0; k < ncol; ++k) {
+    y[k].resize(n);
+    for (int i = 0; i < n; ++i) y[k][i] = ay.at(i, k);
+    double y1 = (y[k][1] - y[k][0])/(x[1] - x[0]);
+    double yn = (y[k][n-1] - y[k][n-2])/(x[n-1] - x[n-2]);
+    y2[k].resize(n);
+    ml_spline(x, y[k], y1, yn, y2[k]);
+  }
+  ua.init(x);
+  Py_END_ALLOW_THREADS
+  if (!s->x->empty()) {
+    PyErr_SetString(PyExc_RuntimeError, "spline is fitted already");
+    return -1;
+  }
+  s->x->swap(x);
+  s->y->swap(y);
+  s->y2->swap(y2);
+  s->ua = ua;
+  s->flat = (ay.ndim() == 1);
+  return 0;
+}
+
+
+static PyObject *splineNew(PyTypeObject *type, PyObject *, PyObject *)
+{
+  SplineObject *s = (SplineObject *) type->tp_alloc(type, 0);
+  if (s == NULL) return NULL;
+  s->x = new vector<double>;
+  s->y = new vector<vector<double> >;
+  s->y2 = new vector<vector<double> >;
+  s->ua.clear();
+  s->flat = 1;
+  return (PyObject *) s;
+}
+
+static void splineDealloc(SplineObject *s)
+{
+  delete s->x;
+  delete s->y;
+  delete s->y2;
+  Py_TYPE(s)->tp_free((PyObject *) s);
+}
+
+
+/*--------------------------------------------------------------------
+  Values (order = 0) or derivatives of the spline at the points "w":
+  array of shape (m,) for 1D values, (m, k) otherwise.
+--------------------------------------------------------------------*/
+static PyObject *splineAt(SplineObject *s, PyObject *ow, int order)
+{
+  if (s->x->size() < 2) {
+    PyErr_SetString(PyExc_ValueError, "spline is not fitted");
+    return NULL;
+  }
+  if ( (order < 0) || (order > 2) ) {
+    PyErr_SetString(PyExc_ValueError, "order must be 0, 1 or 2");
+    return NULL;
+  }
+  DoubleArg aw;
+  if (!aw.get(ow, "w")) return NULL;
+  Py_ssize_t m = aw.size();
+  int ncol = s->y->size();
+  Py_ssize_t shape[2] = { m, ncol };
+  ArrayObject *r = newArray(s->flat ? 1 : 2, shape);
+  if (r == NULL) return NULL;
+
+  const vector<double> &x = *s->x;
+  const vector<vector<double> > &y = *s->y, &y2 = *s->y2;
+  double *res = r->data;
+  Py_BEGIN_ALLOW_THREADS
+  for (Py_ssize_t i = 0; i < m; ++i) {
+    double w = aw.at(i);
+    for (int k = 0; k < ncol; ++k)
+      if (order == 0)
+        res[i*ncol + k] = ml_splint(x, y[k], y2[k], w, &s->ua);
+      else
+        res[i*ncol + k] = ml_splder(x, y[k], y2[k], w, order, &s->ua);
+  }
+  Py_END_ALLOW_THREADS
+  return (PyObject *) r;
+}
+
+static PyObject *splineCall(SplineObject *s, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "w", NULL };
+  PyObject *ow;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", (char **) kwlist, &ow)) return NULL;
+  return splineAt(s, ow, 0);
+}
+
+static PyObject *splineDeriv(SplineObject *s, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "w", "order", NULL };
+  PyObject *ow;
+  int order = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|i", (char **) kwlist, &ow, &order)) return NULL;
+  if (order == 0) order = -1;
+  return splineAt(s, ow, order);
+}
+
+
+/*--------------------------------------------------------------------
+  Moments m_p = integral of x^p y over [lo, hi], p = 0, 1, 2: array
+  of shape (3,) for 1D values, (k, 3) otherwise. The integral is m_0,
+  a float for 1D values.
+--------------------------------------------------------------------*/
+static ArrayObject *splineMomentArray(SplineObject *s, PyObject *args)
+{
+  double lo, hi;
+  if (!PyArg_ParseTuple(args, "dd", &lo, &hi)) return NULL;
+  if (s->x->size() < 2) {
+    PyErr_SetString(PyExc_ValueError, "spline is not fitted");
+    return NULL;
+  }
+  int ncol = s->y->size();
+  Py_ssize_t shape[2] = { ncol, 3 };
+  ArrayObject *r = s->flat ? newArray(1, shape + 1) : newArray(2, shape);
+  if (r == NULL) return NULL;
+  double *res = r->data;
+  Py_BEGIN_ALLOW_THREADS
+  for (int k = 0; k < ncol; ++k)
+    ml_splmoments(*s->x, (*s->y)[k], (*s->y2)[k], lo, hi, res + 3*k, &s->ua);
+  Py_END_ALLOW_THREADS
+  return r;
+}
+
+static PyObject *splineMoments(SplineObject *s, PyObject *args)
+  { return (PyObject *) splineMomentArray(s, args); }
+
+static PyObject *splineIntegral(SplineObject *s, PyObject *args)
+{
+  ArrayObject *m = splineMomentArray(s, args);
+  if (m == NULL) return NULL;
+  PyObject *r;
+  if (s->flat) {
+    r = PyFloat_FromDouble(m->data[0]);
+  } else {
+    Py_ssize_t shape[1] = { m->shape[0] }, strides[1] = { 3 };
+    r = (PyObject *) newArray(1, shape, NULL, (PyObject *) m, m->data, strides);
+  }
+  Py_DECREF(m);
+  return r;
+}
+
+
+/*--------------------------------------------------------------------
+  Arguments of the spline, shared with it.
+--------------------------------------------------------------------*/
+static PyObject *splineX(SplineObject *s, void *)
+{
+  Py_ssize_t shape[1] = { (Py_ssize_t) s->x->size() };
+  return (PyObject *) newArray(1, shape, NULL, (PyObject *) s, s->x->data(), NULL, 1);
+}
+
+static PyMethodDef splineMethods[] = {
+  { "deriv", (PyCFunction) (void (*)(void)) splineDeriv, METH_VARARGS | METH_KEYWORDS,
+    "deriv(w, order = 1): derivatives of the spline at the points w." },
+  { "integral", (PyCFunction) splineIntegral, METH_VARARGS,
+    "integral(lo, hi): integral of the spline over [lo, hi]." },
+  { "moments", (PyCFunction) splineMoments, METH_VARARGS,
+    "moments(lo, hi): integrals of x^p y, p = 0, 1, 2, over [lo, hi]." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef splineGetSet[] = {
+  { (char *) "x", (getter) splineX, NULL, (char *) "Arguments of the spline.", NULL },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+
+/*--------------------------------------------------------------------
+  Table3D object.
+--------------------------------------------------------------------*/
+struct TableObject
+{
+  PyObject_HEAD
+  Table3D *t;
+};
+
+static PyTypeObject TableType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+
+static PyObject *tableNew(PyTypeObject *type, PyObject *, PyObject *)
+{
+  TableObject *o = (TableObject *) type->tp_alloc(type, 0);
+  if (o == NULL) return NULL;
+  o->t = new Table3D;
+  return (PyObject *) o;
+}
+
+static void tableDealloc(TableObject *o)
+{
+  delete o->t;
+  Py_TYPE(o)->tp_free((PyObject *) o);
+}
+
+static int tableInit(TableObject *o, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "name", "order", NULL };
+  const char *name;
+  int order = TABLE3D_FILE_ORDER;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|i", (char **) kwlist, &name, &order))
+    return -1;
+  if ( (order < TABLE3D_FILE_ORDER) || (order > TABLE3D_Y_SLOW) ) {
+    PyErr_SetString(PyExc_ValueError, "order must be 0, 1 or 2");
+    return -1;
+  }
+  if (o->t->getXNum() > 0) {
+    PyErr_SetString(PyExc_RuntimeError, "table is loaded already");
+    return -1;
+  }
+  struct stat st;
+  if (stat(name, &st) != 0) {
+    PyErr_Format(PyExc_OSError, "File %s not found!", name);
+    return -1;
+  }
+
+  // Loaded aside and taken over with the GIL held: other threads may
+  // use the table object meanwhile.
+  Table3D *t = new Table3D;
+  string file_name(name), err;
+  bool ok;
+  Py_BEGIN_ALLOW_THREADS
+  ok = t->load(file_name, order, err);
+  Py_END_ALLOW_THREADS
+  if (!ok) {
+    delete t;
+    PyErr_SetString(PyExc_ValueError, err.c_str());
+    return -1;
+  }
+  if (o->t->getXNum() > 0) {
+    delete t;
+    PyErr_SetString(PyExc_RuntimeError, "table is loaded already");
+    return -1;
+  }
+  delete o->t;
+  o->t = t;
+  return 0;
+}
+
+
+/*--------------------------------------------------------------------
+  Read-only views of the arguments and of the values of the table.
+--------------------------------------------------------------------*/
+static PyObject *tableX(TableObject *o, void *)
+{
+  const vector<double> &a = o->t->getXArray();
+  Py_ssize_t shape[1] = { (Py_ssize_t) a.size() };
+  return (PyObject *) newArray(1, shape, NULL, (PyObject *) o, (double *) a.data(), NULL, 1);
+}
+
+static PyObject *tableY(TableObject *o, void *)
+{
+  const vector<double> &a = o->t->getYArray();
+  Py_ssize_t shape[1] = { (Py_ssize_t) a.size() };
+  return (PyObject *) newArray(1, shape, NULL, (PyObject *) o, (double *) a.data(), NULL, 1);
+}
+
+static PyObject *tableZ(TableObject *o, void *)
+{
+  Table3D &t = *o->t;
+  Py_ssize_t shape[3] = { t.getXNum(), t.getYNum(), t.getChannelNum() };
+  if (shape[0]*shape[1]*shape[2] == 0) {
+    shape[0] = shape[1] = shape[2] = 0;
+    return (PyObject *) newArray(3, shape);
+  }
+  Py_ssize_t strides[3] = { (Py_ssize_t) t.getColumn(0).getStride(), (Py_ssize_t) t.getRow(0).getStride(), 1 };
+  return (PyObject *) newArray(3, shape, NULL, (PyObject *) o, (double *) t.getZAll(0, 0), strides, 1);
+}
+
+
+/*--------------------------------------------------------------------
+  Bilinear interpolation at the points (x[i], y[i]): array of shape
+  (n,) for one channel, (n, k) for all channels (channel = -1).
+--------------------------------------------------------------------*/
+static PyObject *tableInterp(TableObject *o, PyObject *args, PyObject *kwds)
+{
+  static const char *kwlist[] = { "x", "y", "channel", NULL };
+  PyObject *ox, *oy;
+  int c = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|i", (char **) kwlist, &ox, &oy, &c))
+    return NULL;
+  Table3D &t = *o->t;
+  int nch = t.getChannelNum();
+  if ( (t.getXNum() < 2) || (t.getYNum() < 2) ) {
+    PyErr_SetString(PyExc_ValueError, "table grid is less than 2 x 2");
+    return NULL;
+  }
+  if ( (c < -1) || (c >= nch) ) {
+    PyErr_SetString(PyExc_IndexError, "channel out of range");
+    return NULL;
+  }
+  DoubleArg ax, ay;
+  if ( !ax.get(ox, "x") || !ay.get(oy, "y") ) return NULL;
+  Py_ssize_t n = ax.size();
+  if (ay.size() != n) {
+    PyErr_SetString(PyExc_ValueError, "x and y differ in length");
+    return NULL;
+  }
+  Py_ssize_t shape[2] = { n, nch };
+  ArrayObject *r = newArray((c < 0) ? 2 : 1, shape);
+  if (r == NULL) return NULL;
+  double *res = r->data;
+  Py_BEGIN_ALLOW_THREADS
+  if (c < 0)
+    for (Py_ssize_t i = 0; i < n; ++i) t.interp(ax.at(i), ay.at(i), res + i*nch);
+  else
+    for (Py_ssize_t i = 0; i < n; ++i) res[i] = t.interp(ax.at(i), ay.at(i), c);
+  Py_END_ALLOW_THREADS
+  return (PyObject *) r;
+}
+
+static PyObject *tableGetZ(TableObject *o, PyObject *args)
+{
+  int i, j, c = 0;
+  if (!PyArg_ParseTuple(args, "ii|i", &i, &j, &c)) return NULL;
+  Table3D &t = *o->t;
+  if ( (i < 0) || (i >= t.getXNum()) || (j < 0) || (j >= t.getYNum())
+    || (c < 0) || (c >= t.getChannelNum()) ) {
+    PyErr_SetString(PyExc_IndexError, "node out of range");
+    return NULL;
+  }
+  return PyFloat_FromDouble(t.getZ(i, j, c));
+}
+
+static PyObject *tableChannels(TableObject *o, void *)
+  { return PyLong_FromLong(o->t->getChannelNum()); }
+
+static PyMethodDef tableMethods[] = {
+  { "interp", (PyCFunction) (void (*)(void)) tableInterp, METH_VARARGS | METH_KEYWORDS,
+    "interp(x, y, channel = 0): bilinear interpolation at the points, channel = -1 for all." },
+  { "getZ", (PyCFunction) tableGetZ, METH_VARARGS,
+    "getZ(i, j, channel = 0): value at the node." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef tableGetSet[] = {
+  { (char *) "x", (getter) tableX, NULL, (char *) "Array of 1st argument.", NULL },
+  { (char *) "y", (getter) tableY, NULL, (char *) "Array of 2nd argument.", NULL },
+  { (char *) "z", (getter) tableZ, NULL, (char *) "Values of shape (nx, ny, channels).", NULL },
+  { (char *) "channels", (getter) tableChannels, NULL, (char *) "Number of channels.", NULL },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+
+/*--------------------------------------------------------------------
+  Module.
+--------------------------------------------------------------------*/
+static PyMethodDef spectraMethods[] = {
+  { "read", (PyCFunction) (void (*)(void)) spectraRead, METH_VARARGS | METH_KEYWORDS,
+    "read(name, step = 1): columns x, y of the data file." },
+  { NULL, NULL, 0, NULL }
+};
+
+static PyModuleDef spectraModule = {
+  PyModuleDef_HEAD_INIT, "spectra",
+  "Data reader, cubic spline and Table3D with arrays shared through the buffer protocol.",
+  -1, spectraMethods, NULL, NULL, NULL, NULL
+};
+
+
+PyMODINIT_FUNC PyInit_spectra()
+{
+  arrayBuffer.bf_getbuffer = (getbufferproc) arrayGetBuffer;
+  arraySequence.sq_length = (lenfunc) arrayLength;
+  ArrayType.tp_name = "spectra.Array";
+  ArrayType.tp_basicsize = sizeof(ArrayObject);
+  ArrayType.tp_dealloc = (destructor) arrayDealloc;
+  ArrayType.tp_as_buffer = &arrayBuffer;
+  ArrayType.tp_as_sequence = &arraySequence;
+  ArrayType.tp_getset = arrayGetSet;
+  ArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+  ArrayType.tp_doc = "Array of doubles shared through the buffer protocol.";
+
+  SplineType.tp_name = "spectra.Spline";
+  SplineType.tp_basicsize = sizeof(SplineObject);
+  SplineType.tp_new = splineNew;
+  SplineType.tp_init = (initproc) splineInit;
+  SplineType.tp_dealloc = (destructor) splineDealloc;
+  SplineType.tp_call = (ternaryfunc) splineCall;
+  SplineType.tp_methods = splineMethods;
+  SplineType.tp_getset = splineGetSet;
+  SplineType.tp_flags = Py_TPFLAGS_DEFAULT;
+  SplineType.tp_doc = "Spline(x, y): cubic spline through the points.";
+
+  TableType.tp_name = "spectra.Table3D";
+  TableType.tp_basicsize = sizeof(TableObject);
+  TableType.tp_new = tableNew;
+  TableType.tp_init = (initproc) tableInit;
+  TableType.tp_dealloc = (destructor) tableDealloc;
+  TableType.tp_methods = tableMethods;
+  TableType.tp_getset = tableGetSet;
+  TableType.tp_flags = Py_TPFLAGS_DEFAULT;
+  TableType.tp_doc = "Table3D(name, order = 0): tabulated function of two arguments.";
+
+  if ( (PyType_Ready(&ArrayType) < 0) || (PyType_Ready(&SplineType) < 0)
+    || (PyType_Ready(&TableType) < 0) ) return NULL;
+
+  PyObject *m = PyModule_Create(&spectraModule);
+  if (m == NULL) return NULL;
+  Py_INCREF(&ArrayType);
+  Py_INCREF(&SplineType);
+  Py_INCREF(&TableType);
+  PyModule_AddObject(m, "Array", (PyObject *) &ArrayType);
+  PyModule_AddObject(m, "Spline", (PyObject *) &SplineType);
+  PyModule_AddObject(m, "Table3D", (PyObject *) &TableType);
+  PyModule_AddIntConstant(m, "FILE_ORDER", TABLE3D_FILE_ORDER);
+  PyModule_AddIntConstant(m, "X_SLOW", TABLE3D_X_SLOW);
+  PyModule_AddIntConstant(m, "Y_SLOW", TABLE3D_Y_SLOW);
+  return m;
+}
+
+
+//====================================================================
@@ -16,6 +16,16 @@
 #include <iostream>
 #include <sys/stat.h>
 #include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#include "arena.h"
+#include "zstream.h"
+#include "fft.h"
+#include "running_median.h"
+#include "knots.h"
+#include "spline.h"
+#include "spline_grid.h"
+#include "sweep.h"
 using namespace std;
 
 
@@ -31,6 +41,20 @@ const string data_file_name[] = {"11nm-Bare-Exp.dat", "11nm-Bare-Num.dat" };
 // Step to read the data to rare
 const int data_step = 10;
 
+// Hampel despiking of the full data before decimation (see running_median.h): half width of the running median
+// window in input points, 0 to switch off, and threshold in noise sigmas
+const int hampel_half = 0;
+const double hampel_nsigma = 5.0;
+
+/* Choice of spline knots among the read points:
+    0 : every data_step-th point;
+    1 : adaptive by local curvature and noise (see knots.h): tolerance of knot_nsigma noise levels, not less than
+        knot_rel_tol of the range, knots at most knot_max_step points apart. */
+const int knot_mode = 0;
+const double knot_nsigma = 3.0;
+const double knot_rel_tol = 1.0e-3;
+const int knot_max_step = 100;
+
 // Prefix for output file
 const string res_pre_name = "smooth-";
 
@@ -39,27 +63,108 @@ const double wI = 450.0;
 const double wF = 750.0;
 const double wS = 1.0;
 
+// Number of threads, 0 for one per core
+const int thread_num = 0;
+
+// Number of output points evaluated by a thread at once
+const int eval_chunk = 4096;
+
+/* Instrument response stage on the output grid for each file (see fft.h):
+    0 : none;
+    1 : convolution with the response (simulated spectra);
+    2 : deconvolution with Tikhonov regularization resp_reg (measured spectra). */
+const int resp_mode[] = { 0, 0 };
+
+/* Shape of the response:
+    0 : Gaussian;
+    1 : Lorentzian. */
+const int resp_shape = 0;
+
+// Full width at half maximum of the response [nm]
+const double resp_fwhm = 5.0;
+
+// Regularization of deconvolution, relative to the unit response at zero frequency
+const double resp_reg = 1.0e-3;
+
+/* Derivatives of the spline fit written to "deriv-<name>" on the output grid:
+    0 : none;
+    1 : first derivatives of all columns;
+    2 : first and second derivatives of all columns. */
+const int deriv_out = 0;
+
+// Ranges [nm] for area, centroid and width (rms) of the spline fit of every column, written to "moments-<name>"
+const int range_num = 0;
+const double range_lo[] = { 500.0 };
+const double range_hi[] = { 600.0 };
+
+/* Parameter sweep (see sweep.h):
+    0 : none;
+    1 : every file is read once at full resolution and fitted for every step to read the data of sweep_data_step
+        (knots of knot_mode = 0 only) and every output step [nm] of sweep_step, settings in parallel; the fits are
+        written to "sweep-<data step>-<step>-<name>", the rms residuals of the data against the fits to sweep_name */
+const int sweep_mode = 0;
+const int sweep_data_step_num = 4;
+const int sweep_data_step[] = { 5, 10, 15, 20 };
+const int sweep_step_num = 2;
+const double sweep_step[] = { 0.5, 1.0 };
+const string sweep_name = "sweep.dat";
+
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-  Read experimental data rare with integer step of i_step.
+  Buffers of the processing path, kept by each thread for the next file (see arena.h).
 ----------------------------------------------------------------------------------------------------------------------*/
-void read_rare(const string &name, vector<double> &x, vector<double> &y, const int &i_step)
+struct WorkBuffers
+{
+  vector<double> x, row, res, der, fx;
+  vector<vector<double> > y, y2, fy;
+  vector<int> idx;
+  UniformAxis ua;
+  string line, name, text;
+};
+
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+  Read experimental data "x y1 ... yk" rare with integer step of i_step, one vector per column of values.
+----------------------------------------------------------------------------------------------------------------------*/
+void read_rare(const string &name, vector<double> &x, vector<vector<double> > &y, const int &i_step)
 {
   struct stat st;
   if (stat(name.c_str(), &st) != 0) {
     cout << "File " << name << " not found!\n";
     exit(0);
   } else {
-    ifstream fin;
-    fin.open(name.c_str(), ios::in);
+    WorkBuffers &b = workerArena<WorkBuffers>();
+    string &s = b.line;
+    vector<double> &row = b.row;
+    DataInputStream fin(name);
     int i = 0;
-    while (!fin.eof()) {
-      double tmp;
-      fin >> tmp; if ((i%i_step == 0) && (!fin.eof())) x.push_back(tmp);
-      fin >> tmp; if ((i%i_step == 0) && (!fin.eof())) y.push_back(tmp);
+    int ncol = 0;
+    x.clear();
+    while (getline(fin, s)) {
+      row.clear();
+      const char *p = s.c_str();
+      char *end;
+      for (double tmp = strtod(p, &end); end != p; tmp = strtod(p, &end)) {
+        row.push_back(tmp);
+        p = end;
+      }
+      if (row.size() < 2) continue;
+      if (ncol == 0) { ncol = row.size() - 1; arenaResetTable(y, ncol); }
+      if (row.size() - 1 < ncol) continue;
+      if (i%i_step == 0) {
+        x.push_back(row[0]);
+        for (int k = 0; k < ncol; ++k)
+          y[k].push_back(row[k + 1]);
+      }
       i++;
     }
+    if (!fin.error().empty()) {
+      cout << fin.error() << "\n";
+      exit(0);
+    }
+    if (ncol == 0) y.clear();
     fin.close();
   }
 }
@@ -67,79 +172,103 @@ void read_rare(const string &name, vector<double> &x, vector<double> &y, const i
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-  Cubic spline interpolation subroutines. Adopted from [W. H. Press, S. A. Teukolsky, W. T. Vetterling
-  and B. P. Flannery, "Numerical Recipes in Fortran 77 The Art of Scientific Computing (Vol.1)].
+  Keep every i_step-th point of the data
 ----------------------------------------------------------------------------------------------------------------------*/
-void ml_spline(vector<double> x, vector<double> y, double yp1, double ypn, vector<double> &y2)
+void decimate(vector<double> &x, vector<vector<double> > &y, int i_step)
 {
-  int n = y.size();
-  double p, qn, sig, un;
-  vector<double> u(n, 0.0);
-
-  y2[0] = -0.5;
-  u[0] = (3.0/(x[1] - x[0]))*((y[1] - y[0])/(x[1] - x[0]) - yp1);
-  for (int i = 1; i <= n-2; ++i) {
-    sig = (x[i] - x[i-1])/(x[i+1] - x[i-1]);
-    p = sig*y2[i-1] + 2.0;
-    y2[i] = (sig - 1.0)/p;
-    u[i] = (6.0*((y[i+1] - y[i])/(x[i+1] - x[i]) - (y[i] - y[i-1])/(x[i] - x[i-1]))/(x[i+1] - x[i-1]) - sig*u[i-1])/p;
+  int m = 0;
+  for (int i = 0; i < x.size(); i += i_step, ++m) {
+    x[m] = x[i];
+    for (int k = 0; k < y.size(); ++k)
+      y[k][m] = y[k][i];
   }
-  qn = 0.5;
-  un = (3.0/(x[n-1] - x[n-2]))*(ypn - (y[n-1] - y[n-2])/(x[n-1] - x[n-2]));
-  y2[n-1] = (un - qn*u[n-2])/(qn*y2[n-2] + 1.0);
-  for (int k = n - 2; k >= 0; --k)
-    y2[k] = y2[k]*y2[k + 1] + u[k];
+  x.resize(m);
+  for (int k = 0; k < y.size(); ++k)
+    y[k].resize(m);
 }
 
-double ml_splint(vector<double> xa, vector<double> ya, vector<double> y2a, double x)
-{
-  int n = xa.size();
-
-  int klo = 0;
-  int khi = n - 1;
-  while ((khi - klo) > 1) {
-    int k = (khi + klo)/2;
-    if(xa[k] > x)
-      khi = k;
-    else
-      klo = k;
-  }
-  double h = xa[khi] - xa[klo];
-  if (h == 0.0) {
-    cout << "bad xa input in ml_splint!\n";
-    exit(0);
-  }
-  double a = (xa[khi] - x)/h;
-  double b = (x - xa[klo])/h;
-  double y = a*ya[klo] + b*ya[khi] + ((a*a*a - a)*y2a[klo] + (b*b*b - b)*y2a[khi])*h*h/6.0;
-  return y;
-}
 
 
 /*----------------------------------------------------------------------------------------------------------------------
   Main routine
 ----------------------------------------------------------------------------------------------------------------------*/
-void work(const string &data_name, const string &pre_name, const int &i_step)
+void work(const string &data_name, const string &pre_name, const int &i_step, const FFTResponse *resp,
+  ThreadPool &pool)
 {
-  vector<double> x, y, y2;
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  vector<double> &x = b.x;
+  vector<vector<double> > &y = b.y, &y2 = b.y2;
 
   // Read data
-  read_rare(data_name, x, y, i_step);
-
-  int n = y.size();
-  double y1 = (y[1] - y[0])/(x[1] - x[0]);
-  double yn = (y[n-1] - y[n-2])/(x[n-1] - x[n-2]);
-  y2.resize(n);
-  ml_spline(x, y, y1, yn, y2);
+  bool full = (hampel_half > 0) || (knot_mode == 1);
+  read_rare(data_name, x, y, full ? 1 : i_step);
+  if (hampel_half > 0)
+    pool.parallelFor(y.size(), [&](int k) { hampelFilter(y[k], hampel_half, hampel_nsigma); });
+  if (knot_mode == 1) {
+    selectKnots(x, y, knot_nsigma, knot_rel_tol, knot_max_step, b.idx);
+    keepKnots(x, y, b.idx);
+  } else if (full)
+    decimate(x, y, i_step);
 
+  // Fit on the output grid
   int nn = int((wF - wI)/wS) + 1;
-  string file_name = pre_name + data_name;
-  ofstream fout; fout.open(file_name.c_str(), ios::out);
-  for (int i = 0; i < nn; ++i) {
-    double w = wI + i*wS;
-    fout << w << " " << ml_splint(x, y, y2, w) << "\n";
-  }
-  fout.close();
+  fitGrid(x, y, y2, b.ua, wI, wS, nn, eval_chunk, resp, b.res, pool);
+
+  // Derivatives and moments of the spline fit
+  if (deriv_out > 0)
+    writeDerivatives("deriv-" + data_name, x, y, y2, b.ua, wI, wS, nn, deriv_out, eval_chunk, b.der,
+      b.text, pool);
+  if (range_num > 0)
+    writeMoments("moments-" + data_name, x, y, y2, b.ua, range_num, range_lo, range_hi, b.text);
+
+  string &file_name = b.name;
+  file_name.assign(pre_name);
+  file_name += data_name;
+  writeGrid(file_name, b.res, y.size(), wI, wS, nn, b.text);
+}
+
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+  Sweep of the settings for one file, read once at full resolution, despiked and its adaptive knots selected; the
+  settings are fitted in parallel from copies of these data. The sums of squared residuals and their numbers are
+  set for the setting s at s*nfile + i_file. "resp" holds the responses of the steps of sweep_step, NULL if off.
+----------------------------------------------------------------------------------------------------------------------*/
+void sweep(const string &data_name, int i_file, int nfile, const FFTResponse *resp, vector<double> &sum,
+  vector<long> &count, ThreadPool &pool)
+{
+  WorkBuffers &fb = workerArena<WorkBuffers>();
+  const vector<double> &fx = fb.fx;
+  const vector<vector<double> > &fy = fb.fy;
+  read_rare(data_name, fb.fx, fb.fy, 1);
+  if (hampel_half > 0)
+    pool.parallelFor(fy.size(), [&](int k) { hampelFilter(fb.fy[k], hampel_half, hampel_nsigma); });
+  if (knot_mode == 1)
+    selectKnots(fx, fy, knot_nsigma, knot_rel_tol, knot_max_step, fb.idx);
+
+  pool.parallelFor(sweep_data_step_num*sweep_step_num, [&](int s) {
+    WorkBuffers &b = workerArena<WorkBuffers>();
+    int i_step = sweep_data_step[s/sweep_step_num];
+    int is = s%sweep_step_num;
+    double step = sweep_step[is];
+    b.x = fx;
+    b.y = fy;
+    if (knot_mode == 1)
+      keepKnots(b.x, b.y, fb.idx);
+    else
+      decimate(b.x, b.y, i_step);
+    int nn = int((wF - wI)/step) + 1;
+    fitGrid(b.x, b.y, b.y2, b.ua, wI, step, nn, eval_chunk, (resp != NULL) ? &resp[is] : NULL, b.res, pool);
+    size_t ir = size_t(s)*nfile + i_file;
+    sum[ir] = gridResidual(fx, fy, wI, step, nn, b.res.data(), count[ir]);
+
+    char buf[64];
+    snprintf(buf, sizeof(buf), "sweep-%d-%g-", i_step, step);
+    string &file_name = b.name;
+    file_name.assign(buf);
+    file_name += data_name;
+    writeGrid(file_name, b.res, fy.size(), wI, step, nn, b.text);
+  });
 }
 
 
@@ -149,8 +278,44 @@ void work(const string &data_name, const string &pre_name, const int &i_step)
 ***********************************************************************************************************************/
 int main(int argc, char **argv)
 {
+  ThreadPool pool(thread_num);
+
+  // Sweep of the settings: responses per output step
+  if (sweep_mode == 1) {
+    vector<FFTResponse> resp(3*sweep_step_num);
+    for (int i = 0; i < data_file_num; ++i)
+      for (int is = 0; (resp_mode[i] != 0) && (is < sweep_step_num); ++is)
+        resp[resp_mode[i]*sweep_step_num + is].init(int((wF - wI)/sweep_step[is]) + 1, sweep_step[is], resp_shape,
+          resp_fwhm, resp_mode[i], resp_reg);
+    vector<string> files(data_file_name, data_file_name + data_file_num);
+    vector<double> sum(size_t(sweep_data_step_num)*sweep_step_num*data_file_num, 0.0);
+    vector<long> count(sum.size(), 0);
+    pool.parallelFor(data_file_num, [&](int i) {
+      sweep(data_file_name[i], i, data_file_num, (resp_mode[i] != 0) ? &resp[resp_mode[i]*sweep_step_num] : NULL,
+        sum, count, pool);
+#ifdef COUNT_ALLOC
+      printf("%s : %ld allocations so far\n", data_file_name[i].c_str(), allocCount());
+#endif
+    });
+    if (!writeSweepScores(sweep_name, files, sweep_data_step, sweep_data_step_num, sweep_step, sweep_step_num, sum,
+      count))
+      cout << "Can not write file " << sweep_name << "!\n";
+    return 0;
+  }
+
+  // Responses for convolution and deconvolution, shared by the files
+  int nn = int((wF - wI)/wS) + 1;
+  FFTResponse resp[3];
   for (int i = 0; i < data_file_num; ++i)
-    work(data_file_name[i], res_pre_name, data_step);
+    if (resp_mode[i] != 0)
+      resp[resp_mode[i]].init(nn, wS, resp_shape, resp_fwhm, resp_mode[i], resp_reg);
+
+  pool.parallelFor(data_file_num, [&](int i) {
+    work(data_file_name[i], res_pre_name, data_step, (resp_mode[i] != 0) ? &resp[resp_mode[i]] : NULL, pool);
+#ifdef COUNT_ALLOC
+    printf("%s : %ld allocations so far\n", data_file_name[i].c_str(), allocCount());
+#endif
+  });
   return 0;
 };
 
@@ -0,0 +1,380 @@
+/*====================================================================
+
+  THE PROGRAM to run a chain of processing tools over files by a
+    manifest, as a dependency graph of the single files.
+
+  Usage: runner [-n] [manifest]
+
+  Each line of the manifest is a step (# starts a comment):
+
+    <step> <each|all> <input pattern> <output pattern> <command ...>
+
+  Patterns hold at most one "%" matching any part of a file name (the
+  stem). An "each" step runs the command once per matching file with
+  the file as the argument; an "all" step runs it once with all the
+  matching files. Outputs are the output pattern with the stem of
+  each input, or the literal name without "%". Inputs are the files of
+  the current directory that are not outputs of any step, and the
+  outputs of the steps above. Example:
+
+    shift    each  %.dat                    shift-%.dat              ./shift
+    scale    each  shift-%.dat              scale-shift-%.dat        ./scale_conv
+    clean    each  scale-shift-%.dat        clean-scale-shift-%.dat  ./noisy_clean
+    compare  all   clean-scale-shift-5%.dat scale-clean-scale-shift-5%.dat  ./compare_v2
+
+  A file goes on to the next step as soon as its own inputs are made,
+  nodes run on a shared thread pool. Nodes with all outputs newer
+  than the inputs and the program are skipped. A failed node (command
+  error or outputs not made) stops the nodes depending on it. With
+  "-n" the graph is printed and nothing is run.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <errno.h>
+#include "thread_pool.h"
+
+extern char **environ;
+
+
+// Manifest read without the name given.
+const std::string MANIFEST_NAME = "manifest.txt";
+
+// Number of nodes run at once, 0 for one per core.
+const int RUN_THREADS = 0;
+
+
+/*--------------------------------------------------------------------
+  Step of the manifest.
+--------------------------------------------------------------------*/
+struct RunStep
+{
+  std::string name;                   // Name of the step.
+  bool all;                           // One node for all inputs.
+  std::string in_pattern;             // Pattern of inputs.
+  std::string out_pattern;            // Pattern of outputs.
+  std::vector<std::string> command;   // Program and its arguments.
+};
+
+
+/*--------------------------------------------------------------------
+  Node of the graph: one run of the command of the step.
+--------------------------------------------------------------------*/
+struct RunNode
+{
+  int step;                           // Step of the node.
+  std::vector<std::string> inputs;    // Input files.
+  std::vector<std::string> outputs;   // Output files.
+  std::vector<int> after;             // Nodes depending on this one.
+  int waiting;                        // Number of unfinished inputs.
+  bool failed;                        // Node or its input failed.
+};
+
+
+/*--------------------------------------------------------------------
+  Match the name with the pattern, "stem" is set to the part matched
+  by "%".
+--------------------------------------------------------------------*/
+bool matchPattern(const std::string &pattern, const std::string &name, std::string &stem)
+{
+  size_t p = pattern.find('%');
+  if (p == std::string::npos) {
+    stem.clear();
+    return name == pattern;
+  }
+  size_t ns = pattern.size() - p - 1;
+  if (name.size() < p + ns) return false;
+  if (name.compare(0, p, pattern, 0, p) != 0) return false;
+  if (name.compare(name.size() - ns, ns, pattern, p + 1, ns) != 0) return false;
+  stem = name.substr(p, name.size() - p - ns);
+  return true;
+}
+
+
+/*--------------------------------------------------------------------
+  Name made by the pattern with the stem.
+--------------------------------------------------------------------*/
+std::string applyPattern(const std::string &pattern, const std::string &stem)
+{
+  size_t p = pattern.find('%');
+  if (p == std::string::npos) return pattern;
+  return pattern.substr(0, p) + stem + pattern.substr(p + 1);
+}
+
+
+/*--------------------------------------------------------------------
+  Read the steps of the manifest.
+--------------------------------------------------------------------*/
+void readManifest(const std::string &name, std::vector<RunStep> &steps)
+{
+  std::ifstream fin(name.c_str());
+  if (!fin) {
+    std::cout << "File " << name << " not found!\n";
+    exit(0);
+  }
+  std::string s;
+  int nline = 0;
+  while (getline(fin, s)) {
+    ++nline;
+    size_t c = s.find('#');
+    if (c != std::string::npos) s.erase(c);
+    std::istringstream ss(s);
+    RunStep st;
+    std::string mode, word;
+    if (!(ss >> st.name)) continue;
+    ss >> mode >> st.in_pattern >> st.out_pattern;
+    while (ss >> word) st.command.push_back(word);
+    if ( ((mode != "each") && (mode != "all")) || st.command.empty()
+      || (std::count(st.in_pattern.begin(), st.in_pattern.end(), '%') > 1)
+      || (std::count(st.out_pattern.begin(), st.out_pattern.end(), '%') > 1)
+      || ( (mode == "each") && (st.out_pattern.find('%') == std::string::npos) ) ) {
+      std::cout << "Line " << nline << " of " << name << " is not a step!\n";
+      exit(0);
+    }
+    st.all = (mode == "all");
+    steps.push_back(st);
+  }
+}
+
+
+/*--------------------------------------------------------------------
+  Build the graph: nodes of the steps in order, a node waits for the
+  nodes making its inputs.
+--------------------------------------------------------------------*/
+void buildGraph(const std::vector<RunStep> &steps, std::vector<RunNode> &nodes)
+{
+  std::string stem;
+
+  // Files of the current directory which are no outputs.
+  std::vector<std::string> files;
+  DIR *dir = opendir(".");
+  struct dirent *ent;
+  while ( (dir != NULL) && ((ent = readdir(dir)) != NULL) ) {
+    std::string file_name = ent->d_name;
+    struct stat st;
+    if (file_name[0] == '.') continue;
+    if ( (stat(file_name.c_str(), &st) != 0) || !S_ISREG(st.st_mode) ) continue;
+    bool output = false;
+    for (int s = 0; s < steps.size(); ++s)
+      output = output || matchPattern(steps[s].out_pattern, file_name, stem);
+    if (!output) files.push_back(file_name);
+  }
+  if (dir != NULL) closedir(dir);
+  std::sort(files.begin(), files.end());
+
+  std::map<std::string, int> maker;   // Node making the file.
+  for (int s = 0; s < steps.size(); ++s) {
+    const RunStep &st = steps[s];
+    std::vector<std::string> inputs;
+    for (int i = 0; i < files.size(); ++i)
+      if (matchPattern(st.in_pattern, files[i], stem)) inputs.push_back(files[i]);
+    if (inputs.empty()) {
+      std::cout << "No inputs for step " << st.name << "!\n";
+      continue;
+    }
+
+    int first = nodes.size();
+    for (int i = 0; i < inputs.size(); ++i) {
+      if ( !st.all || (i == 0) ) {
+        RunNode node;
+        node.step = s;
+        node.waiting = 0;
+        node.failed = false;
+        nodes.push_back(node);
+      }
+      RunNode &node = nodes.back();
+      node.inputs.push_back(inputs[i]);
+      matchPattern(st.in_pattern, inputs[i], stem);
+      std::string out = applyPattern(st.out_pattern, stem);
+      if (std::find(node.outputs.begin(), node.outputs.end(), out) == node.outputs.end())
+        node.outputs.push_back(out);
+    }
+
+    for (int n = first; n < nodes.size(); ++n) {
+      for (int i = 0; i < nodes[n].inputs.size(); ++i) {
+        std::map<std::string, int>::iterator it = maker.find(nodes[n].inputs[i]);
+        if ( (it == maker.end()) || (std::find(nodes[it->second].after.begin(),
+          nodes[it->second].after.end(), n) != nodes[it->second].after.end()) ) continue;
+        nodes[it->second].after.push_back(n);
+        ++nodes[n].waiting;
+      }
+      for (int o = 0; o < nodes[n].outputs.size(); ++o) {
+        const std::string &out = nodes[n].outputs[o];
+        if (maker.count(out) != 0) {
+          std::cout << "File " << out << " is made by two nodes!\n";
+          exit(0);
+        }
+        maker[out] = n;
+        files.push_back(out);
+      }
+    }
+  }
+}
+
+
+/*--------------------------------------------------------------------
+  Modification time of the file, false if there is no file.
+--------------------------------------------------------------------*/
+bool fileTime(const std::string &name, struct timespec &t)
+{
+  struct stat st;
+  if (stat(name.c_str(), &st) != 0) return false;
+  t = st.st_mtim;
+  return true;
+}
+
+bool isOlder(const struct timespec &a, const struct timespec &b)
+  { return (a.tv_sec < b.tv_sec) || ( (a.tv_sec == b.tv_sec) && (a.tv_nsec < b.tv_nsec) ); }
+
+
+/*--------------------------------------------------------------------
+  All outputs of the node exist and are not older than its inputs and
+  the program (if given by path).
+--------------------------------------------------------------------*/
+bool isUpToDate(const RunNode &node, const RunStep &st)
+{
+  std::vector<std::string> sources(node.inputs);
+  if (st.command[0].find('/') != std::string::npos) sources.push_back(st.command[0]);
+  for (int o = 0; o < node.outputs.size(); ++o) {
+    struct timespec t_out, t_in;
+    if (!fileTime(node.outputs[o], t_out)) return false;
+    for (int i = 0; i < sources.size(); ++i)
+      if ( fileTime(sources[i], t_in) && isOlder(t_out, t_in) ) return false;
+  }
+  return true;
+}
+
+
+/*--------------------------------------------------------------------
+  Run the command of the node, true on success.
+--------------------------------------------------------------------*/
+bool runCommand(const RunNode &node, const RunStep &st)
+{
+  std::vector<char *> args;
+  for (int i = 0; i < st.command.size(); ++i)
+    args.push_back(const_cast<char *>(st.command[i].c_str()));
+  for (int i = 0; i < node.inputs.size(); ++i)
+    args.push_back(const_cast<char *>(node.inputs[i].c_str()));
+  args.push_back(NULL);
+  pid_t pid;
+  if (posix_spawnp(&pid, args[0], NULL, NULL, &args[0], environ) != 0) return false;
+  int status;
+  while (waitpid(pid, &status, 0) < 0)
+    if (errno != EINTR) return false;
+  return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+
+/*--------------------------------------------------------------------
+  Name of the node for messages.
+--------------------------------------------------------------------*/
+std::string nodeName(const RunNode &node, const RunStep &st)
+{
+  std::string s = st.name + " " + node.inputs[0];
+  if (node.inputs.size() > 1) s += " ...";
+  return s;
+}
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  bool dry = false;
+  std::string manifest = MANIFEST_NAME;
+  for (int i = 1; i < argc; ++i)
+    if (strcmp(argv[i], "-n") == 0) dry = true; else manifest = argv[i];
+
+  std::vector<RunStep> steps;
+  std::vector<RunNode> nodes;
+  readManifest(manifest, steps);
+  buildGraph(steps, nodes);
+
+  if (dry) {
+    for (int n = 0; n < nodes.size(); ++n) {
+      const RunNode &node = nodes[n];
+      printf("%d: %s -> %s%s", n, nodeName(node, steps[node.step]).c_str(), node.outputs[0].c_str(),
+        (node.outputs.size() > 1) ? " ..." : "");
+      if (!node.after.empty()) printf("  before");
+      for (int a = 0; a < node.after.size(); ++a) printf(" %d", node.after[a]);
+      printf("%s\n", isUpToDate(node, steps[node.step]) ? "  (up to date)" : "");
+    }
+    return 0;
+  }
+
+  // Ready nodes are taken by the threads of the pool, finished nodes
+  // release the nodes waiting for them.
+  std::deque<int> ready;
+  for (int n = 0; n < nodes.size(); ++n)
+    if (nodes[n].waiting == 0) ready.push_back(n);
+  int remaining = nodes.size();
+  int nrun = 0, nskip = 0, nfail = 0;
+  std::mutex mtx;
+  std::condition_variable cv;
+
+  ThreadPool pool(RUN_THREADS);
+  pool.parallelFor(pool.size(), [&](int) {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;) {
+      while (ready.empty() && (remaining > 0)) cv.wait(lock);
+      if (remaining == 0) return;
+      int n = ready.front();
+      ready.pop_front();
+      RunNode &node = nodes[n];
+      const RunStep &st = steps[node.step];
+      bool failed = node.failed;
+      lock.unlock();
+
+      const char *status;
+      if (failed) {
+        status = "not run, input failed";
+      } else if (isUpToDate(node, st)) {
+        status = "up to date";
+      } else if (runCommand(node, st) && isUpToDate(node, st)) {
+        status = "done";
+      } else {
+        status = "FAILED";
+        failed = true;
+      }
+      printf("%s : %s\n", nodeName(node, st).c_str(), status);
+
+      lock.lock();
+      if (failed) ++nfail; else if (status[0] == 'u') ++nskip; else ++nrun;
+      for (int a = 0; a < node.after.size(); ++a) {
+        RunNode &next = nodes[node.after[a]];
+        if (failed) next.failed = true;
+        if (--next.waiting == 0) ready.push_back(node.after[a]);
+      }
+      --remaining;
+      cv.notify_all();
+    }
+  });
+
+  printf("%d nodes: %d run, %d up to date, %d failed\n", int(nodes.size()), nrun, nskip, nfail);
+  return (nfail > 0) ? 1 : 0;
+}
+
+
+//====================================================================
@@ -0,0 +1,154 @@
+/*====================================================================
+
+  RUNNING MEDIAN AND HAMPEL DESPIKING:
+
+  RunningMedian keeps the median of a sliding window in two ordered
+  multisets (lower and upper halves), so adding, removing and getting
+  the median cost O(log w) for a window of w points. Nodes of the
+  sets are recycled by the thread (see arena.h).
+
+  hampelFilter replaces points deviating from the window median by
+  more than "nsigma" noise levels with the median. The noise level
+  is the running median of absolute differences of neighbour points
+  scaled to sigma of Gaussian noise; it is robust to spikes like the
+  median absolute deviation, but keeps the O(log w) cost per point.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef RUNNING_MEDIAN_H
+#define RUNNING_MEDIAN_H
+
+#include <math.h>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include "arena.h"
+
+
+class RunningMedian
+{
+  private: typedef std::multiset<double, std::less<double>, ArenaAllocator<double> > Half;
+  private: Half lo;   // Lower half, one more if odd size.
+  private: Half hi;   // Upper half.
+
+
+  /*------------------------------------------------------------------
+    Clear object.
+  ------------------------------------------------------------------*/
+  public: void clear()
+    { lo.clear(); hi.clear(); }
+
+
+  /*------------------------------------------------------------------
+    Number of values in the window.
+  ------------------------------------------------------------------*/
+  public: int size() { return lo.size() + hi.size(); }
+
+
+  /*------------------------------------------------------------------
+    Add the value to the window.
+  ------------------------------------------------------------------*/
+  public: void insert(double v)
+  {
+    if ( lo.empty() || (v <= *lo.rbegin()) )
+      lo.insert(v);
+    else
+      hi.insert(v);
+    balance();
+  }
+
+
+  /*------------------------------------------------------------------
+    Remove the value (one copy) from the window.
+  ------------------------------------------------------------------*/
+  public: void erase(double v)
+  {
+    if ( !lo.empty() && (v <= *lo.rbegin()) )
+      lo.erase(lo.find(v));
+    else
+      hi.erase(hi.find(v));
+    balance();
+  }
+
+
+  /*------------------------------------------------------------------
+    Median of the window, mean of the middle values for even size.
+  ------------------------------------------------------------------*/
+  public: double median()
+  {
+    if (lo.size() > hi.size()) return *lo.rbegin();
+    return 0.5*(*lo.rbegin() + *hi.begin());
+  }
+
+
+  /*------------------------------------------------------------------
+    Restore the sizes of the halves.
+  ------------------------------------------------------------------*/
+  private: void balance()
+  {
+    if (lo.size() > hi.size() + 1) {
+      Half::iterator it = --lo.end();
+      hi.insert(*it);
+      lo.erase(it);
+    } else if (hi.size() > lo.size()) {
+      lo.insert(*hi.begin());
+      hi.erase(hi.begin());
+    }
+  }
+
+
+}; //=================================================================
+
+
+/*--------------------------------------------------------------------
+  Hampel filter over the window of 2*half + 1 points centred at each
+  point (clipped at the ends). Returns the number of points replaced.
+--------------------------------------------------------------------*/
+inline int hampelFilter(
+  std::vector<double> &y,   // Data, filtered in place.
+  int half,                 // Half width of the window in points.
+  double nsigma)            // Threshold in noise sigmas.
+{
+  int n = y.size();
+  if ( (half <= 0) || (n < 3) ) return 0;
+
+  // Absolute differences of neighbours: d[i] = |y[i+1] - y[i]|.
+  static thread_local std::vector<double> d, res;   // Kept for the next call.
+  d.resize(n - 1);
+  for (int i = 0; i < n - 1; ++i)
+    d[i] = fabs(y[i+1] - y[i]);
+
+  // sigma = median|d|/(0.6745*sqrt(2)) for Gaussian noise.
+  const double scale = 1.0/(0.67449*sqrt(2.0));
+  RunningMedian med, med_d;
+  res.assign(y.begin(), y.end());
+  int replaced = 0;
+  int top = -1, top_d = -1;   // Last points added to the windows.
+  for (int i = 0; i < n; ++i) {
+    int first = i - half, last = std::min(i + half, n - 1);
+    while (top < last) med.insert(y[++top]);
+    if (first > 0) med.erase(y[first - 1]);
+    int last_d = std::min(i + half, n - 2);
+    while (top_d < last_d) med_d.insert(d[++top_d]);
+    if (first > 0) med_d.erase(d[first - 1]);
+
+    double m = med.median();
+    double s = scale*med_d.median();
+    if (fabs(y[i] - m) > nsigma*s) {
+      res[i] = m;
+      ++replaced;
+    }
+  }
+  y.swap(res);
+  return replaced;
+}
+
+
+#endif // RUNNING_MEDIAN_H
+
+
+//====================================================================
@@ -26,44 +26,103 @@
 #include <errno.h>
 #include <list>
 #include <vector>
+#include <string.h>
+#include "pipeline.h"
 
 
 /*--------------------------------------------------------------------
-  Read two column data from file.
+  Buffers of the processing path, kept by each thread for the next
+  file (see arena.h).
 --------------------------------------------------------------------*/
-bool readTwoColumnData(
-  const std::string &name,  // Name of the file to load the data.
-  std::vector<double> &x,   // Result vector of arguments.
-  std::vector<double> &y)   // Result vector of fcuntion values.
+struct WorkBuffers
 {
-  struct stat st;
-  if(stat(name.c_str(), &st) != 0)
-    return false;
-  else {
-    std::ifstream fin(name.c_str(), std::ios::in);
-    while(!fin.eof()) {
-      double tmp;
-      fin >> tmp; if(!fin.eof()) x.push_back(tmp);
-      fin >> tmp; if(!fin.eof()) y.push_back(tmp);
+  std::vector<double> x, row;
+  std::vector<std::vector<double> > y;
+};
+
+
+/*--------------------------------------------------------------------
+  Parse multi column data "x y1 ... yk" from the file contents.
+  Number of columns is taken from the first data line, lines with
+  fewer numbers are skipped.
+--------------------------------------------------------------------*/
+bool parseMultiColumnData(
+  const std::string &text,                // Contents of the file.
+  std::vector<double> &x,                 // Result vector of arguments.
+  std::vector<std::vector<double> > &y)   // Result vectors of function values, one per column.
+{
+  x.clear();
+  int ncol = 0;
+  std::vector<double> &row = workerArena<WorkBuffers>().row;
+  const char *p = text.c_str();
+  const char *text_end = p + text.size();
+  while(p < text_end) {
+    const char *line_end = (const char *) memchr(p, '\n', text_end - p);
+    if(line_end == NULL) line_end = text_end;
+    row.clear();
+    for(;;) {
+      while((p < line_end) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) ++p;
+      if(p >= line_end) break;
+      char *end;
+      double tmp = strtod(p, &end);
+      if(end == p) break;
+      row.push_back(tmp);
+      p = end;
+    }
+    p = line_end + 1;
+    if(row.size() < 2) continue;
+    if(ncol == 0) { ncol = row.size() - 1; arenaResetTable(y, ncol); }
+    if(row.size() - 1 < ncol) continue;
+    x.push_back(row[0]);
+    for(int k = 0; k < ncol; ++k)
+      y[k].push_back(row[k + 1]);
+  }
+  return !x.empty();
+}
+
+
+/*--------------------------------------------------------------------
+  Format multi column data "x y1 ... yk" as the file contents.
+--------------------------------------------------------------------*/
+void formatMultiColumnData(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  bool reverse,                                 // Flag to write in reverse order.
+  std::string &text)                            // Result contents.
+{
+  int n = x.size();
+  char buf[32];
+  text.clear();
+  for(int j = 0; j < n; ++j) {
+    int i = reverse ? n - 1 - j : j;
+    snprintf(buf, sizeof(buf), "%g", x[i]);
+    text += buf;
+    for(int k = 0; k < y.size(); ++k) {
+      snprintf(buf, sizeof(buf), " %g", y[k][i]);
+      text += buf;
     }
-    fin.close();
-    return true;
+    text += '\n';
   }
 }
 
 
 /*--------------------------------------------------------------------
-  Subroutine to transform and analyze the data.
+  Subroutine to transform and analyze the data. Replaces the file
+  contents read by the pipeline with the output ones.
 --------------------------------------------------------------------*/
-void work(std::string inp_file_name, const double &factor)
+void work(PipelineJob &job, const double &factor)
 {
-  std::vector<double> x, y;
-  if (!readTwoColumnData(inp_file_name, x, y)) return;
-  std::string file_name = "scale_" + inp_file_name;
-  std::ofstream fout(file_name.c_str(), std::ios::out);
-  for(int i = 0; i < y.size(); ++i)
-    fout << x[i] << " " << y[i]*factor << "\n";
-  fout.close();
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  std::vector<double> &x = b.x;
+  std::vector<std::vector<double> > &y = b.y;
+  if (!parseMultiColumnData(job.data, x, y)) { job.ok = false; return; }
+  int ncol = y.size();
+  for(int k = 0; k < ncol; ++k)
+    for(int i = 0; i < x.size(); ++i)
+      y[k][i] *= factor;
+
+  job.name.insert(0, "scale_");
+  formatMultiColumnData(x, y, false, job.data);
 }
 
 
@@ -73,12 +132,14 @@ void work(std::string inp_file_name, const double &factor)
 int main(int argc, char **argv)
 {
   double factor = 100.0/0.0172;
-  work("line_0.dat", factor);
-  work("line_1.dat", factor);
-  work("line_2.dat", factor);
-  work("line_3.dat", factor);
-  work("line_4.dat", factor);
-  work("line_5.dat", factor);
+  std::vector<std::string> file_list;
+  file_list.push_back("line_0.dat");
+  file_list.push_back("line_1.dat");
+  file_list.push_back("line_2.dat");
+  file_list.push_back("line_3.dat");
+  file_list.push_back("line_4.dat");
+  file_list.push_back("line_5.dat");
+  runPipeline(file_list, [&](PipelineJob &job) { work(job, factor); });
   return 0;
 }
 
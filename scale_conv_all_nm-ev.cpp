@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <list>
 #include <vector>
+#include <string.h>
+#include "pipeline.h"
 
 
 /*--------------------------------------------------------------------
@@ -48,6 +50,15 @@ const double FACTOR = 1.0E+10;
     2 : converts nm -> eV. */
 const int CONV = 0;
 
+/* Output mode:
+    0 : one text file per input, named with the prefix;
+    1 : all outputs in the pack PACK_NAME under the same names (see pack.h). */
+const int OUT_MODE = 0;
+const std::string PACK_NAME = "scale.pack";
+
+// Number of files waiting between read, compute and write stages.
+const int PIPE_DEPTH = 4;
+
 
 /*--------------------------------------------------------------------
   Get maximal value of the vector.
@@ -86,25 +97,77 @@ void getFilesInCurrDirectory(
 
 
 /*--------------------------------------------------------------------
-  Read two column data from file.
+  Buffers of the processing path, kept by each thread for the next
+  file (see arena.h).
+--------------------------------------------------------------------*/
+struct WorkBuffers
+{
+  std::vector<double> x, row;
+  std::vector<std::vector<double> > y;
+};
+
+
+/*--------------------------------------------------------------------
+  Parse multi column data "x y1 ... yk" from the file contents.
+  Number of columns is taken from the first data line, lines with
+  fewer numbers are skipped.
+--------------------------------------------------------------------*/
+bool parseMultiColumnData(
+  const std::string &text,                // Contents of the file.
+  std::vector<double> &x,                 // Result vector of arguments.
+  std::vector<std::vector<double> > &y)   // Result vectors of function values, one per column.
+{
+  x.clear();
+  int ncol = 0;
+  std::vector<double> &row = workerArena<WorkBuffers>().row;
+  const char *p = text.c_str();
+  const char *text_end = p + text.size();
+  while(p < text_end) {
+    const char *line_end = (const char *) memchr(p, '\n', text_end - p);
+    if(line_end == NULL) line_end = text_end;
+    row.clear();
+    for(;;) {
+      while((p < line_end) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) ++p;
+      if(p >= line_end) break;
+      char *end;
+      double tmp = strtod(p, &end);
+      if(end == p) break;
+      row.push_back(tmp);
+      p = end;
+    }
+    p = line_end + 1;
+    if(row.size() < 2) continue;
+    if(ncol == 0) { ncol = row.size() - 1; arenaResetTable(y, ncol); }
+    if(row.size() - 1 < ncol) continue;
+    x.push_back(row[0]);
+    for(int k = 0; k < ncol; ++k)
+      y[k].push_back(row[k + 1]);
+  }
+  return !x.empty();
+}
+
+
+/*--------------------------------------------------------------------
+  Format multi column data "x y1 ... yk" as the file contents.
 --------------------------------------------------------------------*/
-bool readTwoColumnData(
-  const std::string &name,  // Name of the file to load the data.
-  std::vector<double> &x,   // Result vector of arguments.
-  std::vector<double> &y)   // Result vector of fcuntion values.
+void formatMultiColumnData(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  bool reverse,                                 // Flag to write in reverse order.
+  std::string &text)                            // Result contents.
 {
-  struct stat st;
-  if(stat(name.c_str(), &st) != 0)
-    return false;
-  else {
-    std::ifstream fin(name.c_str(), std::ios::in);
-    while(!fin.eof()) {
-      double tmp;
-      fin >> tmp; if(!fin.eof()) x.push_back(tmp);
-      fin >> tmp; if(!fin.eof()) y.push_back(tmp);
+  int n = x.size();
+  char buf[32];
+  text.clear();
+  for(int j = 0; j < n; ++j) {
+    int i = reverse ? n - 1 - j : j;
+    snprintf(buf, sizeof(buf), "%g", x[i]);
+    text += buf;
+    for(int k = 0; k < y.size(); ++k) {
+      snprintf(buf, sizeof(buf), " %g", y[k][i]);
+      text += buf;
     }
-    fin.close();
-    return true;
+    text += '\n';
   }
 }
 
@@ -132,26 +195,35 @@ double nm2eV(double nm)
 
 
 /*--------------------------------------------------------------------
-  Subroutine to transform and analyze the data.
+  Subroutine to transform and analyze the data. Replaces the file
+  contents read by the pipeline with the output ones.
 --------------------------------------------------------------------*/
-void work(std::string inp_file_name, const double &factor)
+void work(PipelineJob &job, const double &factor)
 {
-  std::vector<double> x, y;
-  if (!readTwoColumnData(inp_file_name, x, y)) return;
-  int n = y.size();
-
-  std::string file_name = OUT_PRE + inp_file_name;
-  std::ofstream fout(file_name.c_str(), std::ios::out);
-  if (CONV == 0)
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  std::vector<double> &x = b.x;
+  std::vector<std::vector<double> > &y = b.y;
+  if (!parseMultiColumnData(job.data, x, y)) { job.ok = false; return; }
+  int n = x.size();
+  int ncol = y.size();
+
+  // Transform all columns in place.
+  for(int k = 0; k < ncol; ++k)
     for(int i = 0; i < n; ++i)
-      fout << x[i] << " " << y[i]*factor << "\n";
+      y[k][i] *= factor;
   if (CONV == 1)
-    for(int i = n - 1; i >= 0; --i)
-      fout << eV2nm(x[i]) << " " << y[i]*factor << "\n";
+    for(int i = 0; i < n; ++i)
+      x[i] = eV2nm(x[i]);
   if (CONV == 2)
-    for(int i = n - 1; i >= 0; --i)
-      fout << nm2eV(x[i]) << " " << y[i]*factor << "\n";
-  fout.close();
+    for(int i = 0; i < n; ++i)
+      x[i] = nm2eV(x[i]);
+
+  // Conversion reverses the order of arguments.
+  job.name.insert(0, OUT_PRE);
+  if (OUT_MODE == 1)
+    packRecord(job.name, x, y, CONV != 0, job.data);
+  else
+    formatMultiColumnData(x, y, CONV != 0, job.data);
 }
 
 
@@ -161,12 +233,21 @@ void work(std::string inp_file_name, const double &factor)
 int main(int argc, char **argv)
 {
   std::vector<std::string> file_list;
-  getFilesInCurrDirectory(file_list, INPF_END);
-  int nfile = file_list.size();
-  for(int i = 0; i < nfile; ++i) {
-    std::cout << "working on \'" << file_list[i] << "\'\n";
-    work(file_list[i], FACTOR);
+  if (argc > 1)
+    file_list.assign(argv + 1, argv + argc);  // Files given as arguments.
+  else
+    getFilesInCurrDirectory(file_list, INPF_END);
+  PackWriter pack;
+  if ( (OUT_MODE == 1) && !pack.open(PACK_NAME) ) {
+    std::cout << "Can not open pack " << PACK_NAME << "!\n";
+    exit(0);
   }
+  runPipeline(file_list, [](PipelineJob &job) {
+    std::cout << "working on \'" << job.name << "\'\n";
+    work(job, FACTOR);
+  }, PIPE_DEPTH, (OUT_MODE == 1) ? &pack : NULL);
+  if (!pack.close())
+    std::cout << "Can not write pack " << PACK_NAME << "!\n";
   return 0;
 }
 
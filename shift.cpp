@@ -21,6 +21,10 @@
 #include <errno.h>
 #include <list>
 #include <vector>
+#include <string.h>
+#include <algorithm>
+#include "pipeline.h"
+#include "fft.h"
 
 
 // Input file ending.
@@ -32,6 +36,27 @@ const std::string OUT_PRE = "shift-";
 // Shift.
 const double SHIFT = 5.53;
 
+/* Shift mode:
+    0 : constant SHIFT for all files;
+    1 : shift of each file to match the reference REF_NAME, found by FFT cross-correlation of the first value
+        columns on AUTO_GRID points over the reference range, not more than MAX_SHIFT in absolute value. */
+const int SHIFT_MODE = 0;
+const std::string REF_NAME = "reference.dat";
+const int AUTO_GRID = 4096;
+const double MAX_SHIFT = 50.0;
+
+// Number of files computed at once, 0 for one per core.
+const int COMPUTE_THREADS = 0;
+
+/* Output mode:
+    0 : one text file per input, named with the prefix;
+    1 : all outputs in the pack PACK_NAME under the same names (see pack.h). */
+const int OUT_MODE = 0;
+const std::string PACK_NAME = "shift.pack";
+
+// Number of files waiting between read, compute and write stages.
+const int PIPE_DEPTH = 4;
+
 
 /*--------------------------------------------------------------------
   Get list of files in the current directory with certain ending.
@@ -58,43 +83,212 @@ void getFilesInCurrDirectory(
 
 
 /*--------------------------------------------------------------------
-  Read two column data from file.
+  Buffers of the processing path, kept by each thread for the next
+  file (see arena.h).
+--------------------------------------------------------------------*/
+struct WorkBuffers
+{
+  std::vector<double> x, row;
+  std::vector<std::vector<double> > y;
+  std::vector<std::complex<double> > c;    // Cross-correlation.
+};
+
+
+/*--------------------------------------------------------------------
+  Parse multi column data "x y1 ... yk" from the file contents.
+  Number of columns is taken from the first data line, lines with
+  fewer numbers are skipped.
+--------------------------------------------------------------------*/
+bool parseMultiColumnData(
+  const std::string &text,                // Contents of the file.
+  std::vector<double> &x,                 // Result vector of arguments.
+  std::vector<std::vector<double> > &y)   // Result vectors of function values, one per column.
+{
+  x.clear();
+  int ncol = 0;
+  std::vector<double> &row = workerArena<WorkBuffers>().row;
+  const char *p = text.c_str();
+  const char *text_end = p + text.size();
+  while(p < text_end) {
+    const char *line_end = (const char *) memchr(p, '\n', text_end - p);
+    if(line_end == NULL) line_end = text_end;
+    row.clear();
+    for(;;) {
+      while((p < line_end) && ((*p == ' ') || (*p == '\t') || (*p == '\r'))) ++p;
+      if(p >= line_end) break;
+      char *end;
+      double tmp = strtod(p, &end);
+      if(end == p) break;
+      row.push_back(tmp);
+      p = end;
+    }
+    p = line_end + 1;
+    if(row.size() < 2) continue;
+    if(ncol == 0) { ncol = row.size() - 1; arenaResetTable(y, ncol); }
+    if(row.size() - 1 < ncol) continue;
+    x.push_back(row[0]);
+    for(int k = 0; k < ncol; ++k)
+      y[k].push_back(row[k + 1]);
+  }
+  return !x.empty();
+}
+
+
+/*--------------------------------------------------------------------
+  Format multi column data "x y1 ... yk" as the file contents.
 --------------------------------------------------------------------*/
-bool readTwoColumnData(
-  const std::string &name,  // Name of the file to load the data.
-  std::vector<double> &x,   // Result vector of arguments.
-  std::vector<double> &y)   // Result vector of fcuntion values.
+void formatMultiColumnData(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  bool reverse,                                 // Flag to write in reverse order.
+  std::string &text)                            // Result contents.
 {
-  struct stat st;
-  if(stat(name.c_str(), &st) != 0)
-    return false;
-  else {
-    std::ifstream fin(name.c_str(), std::ios::in);
-    while(!fin.eof()) {
-      double tmp;
-      fin >> tmp; if(!fin.eof()) x.push_back(tmp);
-      fin >> tmp; if(!fin.eof()) y.push_back(tmp);
+  int n = x.size();
+  char buf[32];
+  text.clear();
+  for(int j = 0; j < n; ++j) {
+    int i = reverse ? n - 1 - j : j;
+    snprintf(buf, sizeof(buf), "%g", x[i]);
+    text += buf;
+    for(int k = 0; k < y.size(); ++k) {
+      snprintf(buf, sizeof(buf), " %g", y[k][i]);
+      text += buf;
     }
-    fin.close();
-    return true;
+    text += '\n';
   }
 }
 
 
 /*--------------------------------------------------------------------
-  Subroutine to shift the data.
+  Reference for automatic shift: transform of its first value column
+  resampled on the uniform grid.
+--------------------------------------------------------------------*/
+struct ShiftReference
+{
+  double x0, dx;                                // Grid start and step.
+  int n;                                        // Number of grid points.
+  const FFTPlan *plan;                          // Plan for zero padded grid.
+  std::vector<std::complex<double> > spec;      // Conjugate transform.
+};
+
+
+/*--------------------------------------------------------------------
+  Resample the first value column on the grid by linear
+  interpolation, minus its mean; zero outside the data and in the
+  padding.
 --------------------------------------------------------------------*/
-void shiftData(std::string inp_file_name, const double &sft)
+void resampleCentered(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<double> &y,                 // Values.
+  const ShiftReference &ref,                    // Grid.
+  std::vector<std::complex<double> > &out)      // Result, ref.plan->size() points.
 {
-  std::vector<double> x, y;
-  if (!readTwoColumnData(inp_file_name, x, y)) return;
-  int n = y.size();
+  // Points taken in increasing order of arguments.
+  int n = x.size();
+  bool rev = (x.front() > x.back());
+  auto xa = [&](int j) { return x[rev ? n - 1 - j : j]; };
+  auto ya = [&](int j) { return y[rev ? n - 1 - j : j]; };
 
-  std::string file_name = OUT_PRE + inp_file_name;
-  std::ofstream fout(file_name.c_str(), std::ios::out);
+  out.assign(ref.plan->size(), 0.0);
+  double sum = 0.0;
+  int first = ref.n, last = -1;   // Grid points inside the data.
+  int j = 0;
+  for (int i = 0; i < ref.n; ++i) {
+    double t = ref.x0 + i*ref.dx;
+    if ( (t < xa(0)) || (t > xa(n-1)) ) continue;
+    while ( (j < n - 2) && (xa(j+1) < t) ) ++j;
+    double h = xa(j+1) - xa(j);
+    double v = (h > 0.0) ? ya(j) + (ya(j+1) - ya(j))*(t - xa(j))/h : ya(j);
+    out[i] = v;
+    sum += v;
+    first = std::min(first, i);
+    last = i;
+  }
+  for (int i = first; i <= last; ++i)
+    out[i] -= sum/(last - first + 1);
+}
+
+
+/*--------------------------------------------------------------------
+  Prepare the reference from its file.
+--------------------------------------------------------------------*/
+void initShiftReference(ShiftReference &ref, const std::string &name)
+{
+  std::string text, err;
+  std::vector<double> x;
+  std::vector<std::vector<double> > y;
+  if (!pipelineReadFile(name, text, err)) {
+    std::cout << err << "\n";
+    exit(0);
+  }
+  if ( !parseMultiColumnData(text, x, y) || (x.size() < 2) ) {
+    std::cout << "Reference " << name << " not read!\n";
+    exit(0);
+  }
+  ref.n = AUTO_GRID;
+  ref.x0 = std::min(x.front(), x.back());
+  ref.dx = fabs(x.back() - x.front())/(ref.n - 1);
+  ref.plan = &fftPlan(fftSize(2*ref.n));
+  resampleCentered(x, y[0], ref, ref.spec);
+  ref.plan->transform(&ref.spec[0], false);
+  for (int i = 0; i < ref.spec.size(); ++i)
+    ref.spec[i] = std::conj(ref.spec[i]);
+}
+
+
+/*--------------------------------------------------------------------
+  Shift to add to the arguments to match the reference: maximum of
+  the cross-correlation refined by the parabola through three points.
+--------------------------------------------------------------------*/
+double findShift(
+  const ShiftReference &ref,                    // Reference.
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<double> &y)                 // Values.
+{
+  std::vector<std::complex<double> > &c = workerArena<WorkBuffers>().c;
+  resampleCentered(x, y, ref, c);
+  ref.plan->transform(&c[0], false);
+  for (int i = 0; i < c.size(); ++i)
+    c[i] *= ref.spec[i];
+  ref.plan->transform(&c[0], true);
+
+  // c[l] = sum of ref(i)*data(i + l), lags wrap around.
+  int m = c.size();
+  int lmax = std::min(int(MAX_SHIFT/ref.dx), ref.n - 1);
+  int best = 0;
+  for (int l = -lmax; l <= lmax; ++l)
+    if (c[(l + m)%m].real() > c[(best + m)%m].real()) best = l;
+  double cm = c[(best - 1 + m)%m].real(), c0 = c[(best + m)%m].real(), cp = c[(best + 1 + m)%m].real();
+  double den = cm - 2.0*c0 + cp;
+  double lag = best + ((den < 0.0) ? 0.5*(cm - cp)/den : 0.0);
+  return -lag*ref.dx;
+}
+
+
+/*--------------------------------------------------------------------
+  Subroutine to shift the data. Replaces the file contents read by
+  the pipeline with the output ones. With the reference given the
+  shift is found for the file.
+--------------------------------------------------------------------*/
+void shiftData(PipelineJob &job, double sft, const ShiftReference *ref)
+{
+  WorkBuffers &b = workerArena<WorkBuffers>();
+  std::vector<double> &x = b.x;
+  std::vector<std::vector<double> > &y = b.y;
+  if (!parseMultiColumnData(job.data, x, y)) { job.ok = false; return; }
+  if ( (ref != NULL) && (x.size() >= 2) ) {
+    sft = findShift(*ref, x, y[0]);
+    printf("%s : shift %g\n", job.name.c_str(), sft);
+  }
+  int n = x.size();
   for(int i = 0; i < n; ++i)
-    fout << x[i] + sft << " " << y[i] << "\n";
-  fout.close();
+    x[i] += sft;
+
+  job.name.insert(0, OUT_PRE);
+  if (OUT_MODE == 1)
+    packRecord(job.name, x, y, false, job.data);
+  else
+    formatMultiColumnData(x, y, false, job.data);
 }
 
 
@@ -104,12 +298,26 @@ void shiftData(std::string inp_file_name, const double &sft)
 int main(int argc, char **argv)
 {
   std::vector<std::string> file_list;
-  getFilesInCurrDirectory(file_list, INPF_END);
-  int nfile = file_list.size();
-  for(int i = 0; i < nfile; ++i) {
-    std::cout << "working on \'" << file_list[i] << "\'\n";
-    shiftData(file_list[i], SHIFT);
+  if (argc > 1)
+    file_list.assign(argv + 1, argv + argc);  // Files given as arguments.
+  else
+    getFilesInCurrDirectory(file_list, INPF_END);
+  ShiftReference ref;
+  if (SHIFT_MODE == 1) {
+    initShiftReference(ref, REF_NAME);
+    file_list.erase(std::remove(file_list.begin(), file_list.end(), REF_NAME), file_list.end());
+  }
+  PackWriter pack;
+  if ( (OUT_MODE == 1) && !pack.open(PACK_NAME) ) {
+    std::cout << "Can not open pack " << PACK_NAME << "!\n";
+    exit(0);
   }
+  runPipeline(file_list, [&](PipelineJob &job) {
+    printf("working on \'%s\'\n", job.name.c_str());
+    shiftData(job, SHIFT, (SHIFT_MODE == 1) ? &ref : NULL);
+  }, PIPE_DEPTH, (OUT_MODE == 1) ? &pack : NULL, COMPUTE_THREADS);
+  if (!pack.close())
+    std::cout << "Can not write pack " << PACK_NAME << "!\n";
   return 0;
 }
 
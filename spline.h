@@ -0,0 +1,166 @@
+/*====================================================================
+
+  CUBIC SPLINE ENGINE:
+
+  Interpolating cubic spline of noisy_clean.cpp and rare_interpol.cpp
+  with analytic derivatives, definite integrals and moments taken
+  from the piecewise cubic coefficients, so areas, centroids and
+  widths need no resampling on a fine grid. With the uniform axis of
+  the knots given (see uniform_axis.h) the interval of an argument is
+  found in O(1) instead of bisection.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef SPLINE_H
+#define SPLINE_H
+
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "uniform_axis.h"
+
+
+/*--------------------------------------------------------------------
+  Cubic spline interpolation subroutines. Adopted from [W. H. Press,
+  S. A. Teukolsky, W. T. Vetterling and B. P. Flannery, "Numerical
+  Recipes in Fortran 77 The Art of Scientific Computing (Vol.1)].
+  The work vector is kept by the thread for the next call.
+--------------------------------------------------------------------*/
+inline void ml_spline(const std::vector<double> &x, const std::vector<double> &y, double yp1, double ypn,
+  std::vector<double> &y2)
+{
+  int n = y.size();
+  double p, qn, sig, un;
+  static thread_local std::vector<double> u;
+  u.assign(n, 0.0);
+
+  y2[0] = -0.5;
+  u[0] = (3.0/(x[1] - x[0]))*((y[1] - y[0])/(x[1] - x[0]) - yp1);
+  for (int i = 1; i <= n-2; ++i) {
+    sig = (x[i] - x[i-1])/(x[i+1] - x[i-1]);
+    p = sig*y2[i-1] + 2.0;
+    y2[i] = (sig - 1.0)/p;
+    u[i] = (6.0*((y[i+1] - y[i])/(x[i+1] - x[i]) - (y[i] - y[i-1])/(x[i] - x[i-1]))/(x[i+1] - x[i-1]) - sig*u[i-1])/p;
+  }
+  qn = 0.5;
+  un = (3.0/(x[n-1] - x[n-2]))*(ypn - (y[n-1] - y[n-2])/(x[n-1] - x[n-2]));
+  y2[n-1] = (un - qn*u[n-2])/(qn*y2[n-2] + 1.0);
+  for (int k = n - 2; k >= 0; --k)
+    y2[k] = y2[k]*y2[k + 1] + u[k];
+}
+
+inline double ml_splint(const std::vector<double> &xa, const std::vector<double> &ya, const std::vector<double> &y2a, double x,
+  const UniformAxis *ua = NULL)
+{
+  int n = xa.size();
+
+  int klo = 0;
+  int khi = n - 1;
+  if ( (ua != NULL) && ua->isUniform() ) {
+    klo = ua->locate(x, &xa[0]);
+    khi = klo + 1;
+  } else
+    while ((khi - klo) > 1) {
+      int k = (khi + klo)/2;
+      if(xa[k] > x)
+        khi = k;
+      else
+        klo = k;
+    }
+  double h = xa[khi] - xa[klo];
+  if (h == 0.0) {
+    std::cout << "bad xa input in ml_splint!\n";
+    exit(0);
+  }
+  double a = (xa[khi] - x)/h;
+  double b = (x - xa[klo])/h;
+  double y = a*ya[klo] + b*ya[khi] + ((a*a*a - a)*y2a[klo] + (b*b*b - b)*y2a[khi])*h*h/6.0;
+  return y;
+}
+
+
+/*--------------------------------------------------------------------
+  Interval [xa[k], xa[k+1]] holding x, k in [0, n-2].
+--------------------------------------------------------------------*/
+inline int ml_locate(const std::vector<double> &xa, double x, const UniformAxis *ua = NULL)
+{
+  if ( (ua != NULL) && ua->isUniform() ) return ua->locate(x, &xa[0]);
+  return std::upper_bound(xa.begin() + 1, xa.end() - 1, x) - xa.begin() - 1;
+}
+
+
+/*--------------------------------------------------------------------
+  First (order = 1) or second (order = 2) derivative of the spline.
+--------------------------------------------------------------------*/
+inline double ml_splder(const std::vector<double> &xa, const std::vector<double> &ya, const std::vector<double> &y2a,
+  double x, int order, const UniformAxis *ua = NULL)
+{
+  int klo = ml_locate(xa, x, ua), khi = klo + 1;
+  double h = xa[khi] - xa[klo];
+  double a = (xa[khi] - x)/h;
+  double b = (x - xa[klo])/h;
+  if (order == 2)
+    return a*y2a[klo] + b*y2a[khi];
+  return (ya[khi] - ya[klo])/h + ((1.0 - 3.0*a*a)*y2a[klo] + (3.0*b*b - 1.0)*y2a[khi])*h/6.0;
+}
+
+
+/*--------------------------------------------------------------------
+  Moments of the spline over [x1, x2] clipped to the data range:
+  m[p] = integral of x^p y(x), p = 0, 1, 2. The spline times x^2 is
+  a polynomial of degree 5 on each interval, so three-point
+  Gauss-Legendre quadrature gives the moments exactly.
+--------------------------------------------------------------------*/
+inline void ml_splmoments(const std::vector<double> &xa, const std::vector<double> &ya, const std::vector<double> &y2a,
+  double x1, double x2, double m[3], const UniformAxis *ua = NULL)
+{
+  m[0] = m[1] = m[2] = 0.0;
+  int n = xa.size();
+  x1 = std::max(x1, xa[0]);
+  x2 = std::min(x2, xa[n-1]);
+  if (x2 <= x1) return;
+
+  const double gt[3] = { -sqrt(0.6), 0.0, sqrt(0.6) };
+  const double gw[3] = { 5.0/9.0, 8.0/9.0, 5.0/9.0 };
+  for (int k = ml_locate(xa, x1, ua); (k < n - 1) && (xa[k] < x2); ++k) {
+    double lo = std::max(xa[k], x1), hi = std::min(xa[k+1], x2);
+    if (hi <= lo) continue;
+    double h = xa[k+1] - xa[k];
+    double c = 0.5*(lo + hi), r = 0.5*(hi - lo);
+    for (int g = 0; g < 3; ++g) {
+      double x = c + r*gt[g];
+      double a = (xa[k+1] - x)/h;
+      double b = 1.0 - a;
+      double y = a*ya[k] + b*ya[k+1] + ((a*a*a - a)*y2a[k] + (b*b*b - b)*y2a[k+1])*h*h/6.0;
+      double w = gw[g]*r*y;
+      m[0] += w;
+      m[1] += w*x;
+      m[2] += w*x*x;
+    }
+  }
+}
+
+
+/*--------------------------------------------------------------------
+  Definite integral of the spline over [x1, x2] clipped to the data
+  range.
+--------------------------------------------------------------------*/
+inline double ml_splintegral(const std::vector<double> &xa, const std::vector<double> &ya, const std::vector<double> &y2a,
+  double x1, double x2, const UniformAxis *ua = NULL)
+{
+  double m[3];
+  ml_splmoments(xa, ya, y2a, x1, x2, m, ua);
+  return m[0];
+}
+
+
+#endif // SPLINE_H
+
+
+//====================================================================
@@ -0,0 +1,174 @@
+/*====================================================================
+
+  SPLINE FIT ON THE OUTPUT GRID:
+
+  Common steps of the batch tools fitting data with the cubic spline
+  (see spline.h): the fit of all columns on the uniform output grid
+  w0 + i*step, i = 0 ... nn-1, with the instrument response (see
+  fft.h), and the output of the fit, its derivatives and moments.
+  Columns are fitted and chunks of "chunk" output points are
+  evaluated in parallel on the pool (see thread_pool.h).
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef SPLINE_GRID_H
+#define SPLINE_GRID_H
+
+#include <stdio.h>
+#include <math.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "thread_pool.h"
+#include "arena.h"
+#include "fft.h"
+#include "spline.h"
+
+
+/*--------------------------------------------------------------------
+  Spline fit of the knots "x", "y" on the grid into "res", point by
+  point, with the instrument response "resp" if given. Second
+  derivatives of the columns are set to "y2", the uniform axis of
+  the knots, if any, to "ua".
+--------------------------------------------------------------------*/
+inline void fitGrid(
+  const std::vector<double> &x,                 // Knots.
+  const std::vector<std::vector<double> > &y,   // Values at the knots, one vector per column.
+  std::vector<std::vector<double> > &y2,        // Result second derivatives.
+  UniformAxis &ua,                              // Result uniform axis of the knots.
+  double w0,                                    // First point of the grid.
+  double step,                                  // Step of the grid.
+  int nn,                                       // Number of grid points.
+  int chunk,                                    // Points evaluated by a thread at once.
+  const FFTResponse *resp,                      // Instrument response, NULL if none.
+  std::vector<double> &res,                     // Result fit.
+  ThreadPool &pool)
+{
+  // Spline all columns over the common arguments.
+  int n = x.size();
+  int ncol = y.size();
+  y2.resize(ncol);
+  pool.parallelFor(ncol, [&](int k) {
+    double y1 = (y[k][1] - y[k][0])/(x[1] - x[0]);
+    double yn = (y[k][n-1] - y[k][n-2])/(x[n-1] - x[n-2]);
+    y2[k].resize(n);
+    ml_spline(x, y[k], y1, yn, y2[k]);
+  });
+
+  // Knots of uniform step are located without bisection.
+  ua.init(x);
+
+  // Evaluate chunks of points in parallel.
+  res.resize(size_t(nn)*ncol);
+  int nchunk = (nn + chunk - 1)/chunk;
+  pool.parallelFor(nchunk, [&](int ic) {
+    int i_end = std::min(nn, (ic + 1)*chunk);
+    for (int i = ic*chunk; i < i_end; ++i) {
+      double w = w0 + i*step;
+      for (int k = 0; k < ncol; ++k)
+        res[size_t(i)*ncol + k] = ml_splint(x, y[k], y2[k], w, &ua);
+    }
+  });
+
+  // Instrument response, two columns per transform.
+  if (resp != NULL)
+    pool.parallelFor((ncol + 1)/2, [&](int ip) {
+      int k = 2*ip;
+      resp->apply(&res[k], (k + 1 < ncol) ? &res[k + 1] : NULL, ncol);
+    });
+}
+
+
+/*--------------------------------------------------------------------
+  Write the fit "res" of "ncol" columns on the grid: "w y1 ... yk".
+  The text is built in "text", kept by the caller.
+--------------------------------------------------------------------*/
+inline void writeGrid(const std::string &file_name, const std::vector<double> &res, int ncol, double w0,
+  double step, int nn, std::string &text)
+{
+  char buf[32];
+  text.clear();
+  for (int i = 0; i < nn; ++i) {
+    snprintf(buf, sizeof(buf), "%g", w0 + i*step);
+    text += buf;
+    for (int k = 0; k < ncol; ++k) {
+      snprintf(buf, sizeof(buf), " %g", res[size_t(i)*ncol + k]);
+      text += buf;
+    }
+    text += '\n';
+  }
+  if (!arenaWriteFile(file_name, text))
+    std::cout << "Can not write file " << file_name << "!\n";
+}
+
+
+/*--------------------------------------------------------------------
+  Write derivatives of the spline fit on the grid, up to the "order"
+  1 or 2: "w y1' (y1'') ... yk' (yk'')". The values are evaluated
+  into "der" and the text is built in "text", both kept by the caller.
+--------------------------------------------------------------------*/
+inline void writeDerivatives(
+  const std::string &file_name,                 // Name of the output file.
+  const std::vector<double> &x,                 // Knots.
+  const std::vector<std::vector<double> > &y,   // Values at the knots, one vector per column.
+  const std::vector<std::vector<double> > &y2,  // Second derivatives.
+  const UniformAxis &ua,                        // Uniform axis of the knots.
+  double w0,                                    // First point of the grid.
+  double step,                                  // Step of the grid.
+  int nn,                                       // Number of grid points.
+  int order,                                    // Highest order of derivatives.
+  int chunk,                                    // Points evaluated by a thread at once.
+  std::vector<double> &der,                     // Buffer of the derivatives.
+  std::string &text,                            // Buffer of the text.
+  ThreadPool &pool)
+{
+  int ncol = y.size();
+  int nval = ncol*order;
+  der.resize(size_t(nn)*nval);
+  int nchunk = (nn + chunk - 1)/chunk;
+  pool.parallelFor(nchunk, [&](int ic) {
+    int i_end = std::min(nn, (ic + 1)*chunk);
+    for (int i = ic*chunk; i < i_end; ++i)
+      for (int k = 0; k < ncol; ++k)
+        for (int d = 0; d < order; ++d)
+          der[size_t(i)*nval + k*order + d] = ml_splder(x, y[k], y2[k], w0 + i*step, d + 1, &ua);
+  });
+  writeGrid(file_name, der, nval, w0, step, nn, text);
+}
+
+
+/*--------------------------------------------------------------------
+  Write area, centroid and width (rms) of the spline fit of every
+  column over the ranges [lo[r], hi[r]], r = 0 ... nrange-1: "lo hi
+  column area centroid width". The text is built in "text", kept by
+  the caller.
+--------------------------------------------------------------------*/
+inline void writeMoments(const std::string &file_name, const std::vector<double> &x,
+  const std::vector<std::vector<double> > &y, const std::vector<std::vector<double> > &y2, const UniformAxis &ua,
+  int nrange, const double *lo, const double *hi, std::string &text)
+{
+  char buf[128];
+  text.clear();
+  for (int r = 0; r < nrange; ++r)
+    for (int k = 0; k < y.size(); ++k) {
+      double m[3];
+      ml_splmoments(x, y[k], y2[k], lo[r], hi[r], m, &ua);
+      double c = (m[0] != 0.0) ? m[1]/m[0] : 0.0;
+      double v = (m[0] != 0.0) ? m[2]/m[0] - c*c : 0.0;
+      snprintf(buf, sizeof(buf), "%g %g %d %g %g %g\n", lo[r], hi[r], k + 1, m[0], c, sqrt(std::max(v, 0.0)));
+      text += buf;
+    }
+  if (!arenaWriteFile(file_name, text))
+    std::cout << "Can not write file " << file_name << "!\n";
+}
+
+
+#endif // SPLINE_GRID_H
+
+
+//====================================================================
@@ -0,0 +1,106 @@
+/*====================================================================
+
+  SCORES OF A PARAMETER SWEEP:
+
+  A sweep fits every input, read once at full resolution, for a grid
+  of settings (factor to rare data x output step). A setting is scored
+  by the rms residual of the full-resolution data against its fit on
+  the output grid, interpolated linearly between the grid points as
+  the output is read. The residual falls as the knots and the grid get
+  finer and levels off at the noise of the data once the signal is
+  resolved: the coarsest setting near that level smooths most without
+  losing the signal. Scores of all settings are put in one table to
+  choose the parameters in a single run.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+
+/*--------------------------------------------------------------------
+  Sum of squared residuals of the points "x", "y" (one vector per
+  column) against the fit "res" on the grid w0 + i*step, i = 0 ...
+  nn-1, with the values of all columns at each grid point. Points out
+  of the grid are skipped; "count" is increased by the number of the
+  residuals summed.
+--------------------------------------------------------------------*/
+inline double gridResidual(
+  const std::vector<double> &x,                 // Arguments.
+  const std::vector<std::vector<double> > &y,   // Function values, one vector per column.
+  double w0,                                    // First point of the grid.
+  double step,                                  // Step of the grid.
+  int nn,                                       // Number of grid points.
+  const double *res,                            // Fit on the grid, point by point.
+  long &count)                                  // Number of residuals.
+{
+  int ncol = y.size();
+  double sum = 0.0;
+  if (nn < 2) return sum;
+  for (size_t j = 0; j < x.size(); ++j) {
+    double t = (x[j] - w0)/step;
+    if ( (t < 0.0) || (t > nn - 1) ) continue;
+    int i = std::min(int(t), nn - 2);
+    t -= i;
+    const double *r = res + size_t(i)*ncol;
+    for (int k = 0; k < ncol; ++k) {
+      double d = y[k][j] - ((1.0 - t)*r[k] + t*r[ncol + k]);
+      sum += d*d;
+    }
+    count += ncol;
+  }
+  return sum;
+}
+
+
+/*--------------------------------------------------------------------
+  Write the scores of the sweep over rare[0 ... nrare-1] and
+  step[0 ... nstep-1], one line per setting "rare step rms rms_1 ...
+  rms_m": rms residual over all files and of each file. The sums of
+  squares "sum" and numbers "count" of the residuals are given for
+  setting s = i_rare*nstep + i_step and file f at s*nfile + f.
+  Returns false if the file can not be written.
+--------------------------------------------------------------------*/
+inline bool writeSweepScores(const std::string &name, const std::vector<std::string> &files,
+  const int *rare, int nrare, const double *step, int nstep,
+  const std::vector<double> &sum, const std::vector<long> &count)
+{
+  FILE *f = fopen(name.c_str(), "w");
+  if (f == NULL) return false;
+  int nfile = files.size();
+  fprintf(f, "# rare step rms");
+  for (int i = 0; i < nfile; ++i)
+    fprintf(f, " %s", files[i].c_str());
+  fprintf(f, "\n");
+  for (int s = 0; s < nrare*nstep; ++s) {
+    double s2 = 0.0;
+    long m = 0;
+    for (int i = 0; i < nfile; ++i) {
+      s2 += sum[size_t(s)*nfile + i];
+      m += count[size_t(s)*nfile + i];
+    }
+    fprintf(f, "%d %g %g", rare[s/nstep], step[s%nstep], (m > 0) ? sqrt(s2/m) : 0.0);
+    for (int i = 0; i < nfile; ++i) {
+      long c = count[size_t(s)*nfile + i];
+      fprintf(f, " %g", (c > 0) ? sqrt(sum[size_t(s)*nfile + i]/c) : 0.0);
+    }
+    fprintf(f, "\n");
+  }
+  return fclose(f) == 0;
+}
+
+
+#endif // SWEEP_H
+
+
+//====================================================================
@@ -0,0 +1,114 @@
+/*====================================================================
+
+  BENCHMARK of scattered queries to the tabulated function of two
+  arguments: row-major Table3D against cache-blocked Table3DTiled
+  (see table3d.h) for random and path-like access patterns.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include "table3d.h"
+#include <chrono>
+#include <random>
+
+
+/*********************************************************************
+  Basic parameters to setup.
+*********************************************************************/
+
+// Grid size of the table.
+const int NX = 8192;
+const int NY = 8192;
+
+// Number of queries per run.
+const int NQUERY = 3000000;
+
+// Step of the path-like walk in grid cells.
+const double PATH_STEP = 2.0;
+
+
+/*--------------------------------------------------------------------
+  Generate query points: uniformly random or a random walk.
+--------------------------------------------------------------------*/
+void makeQueries(bool path, vector<double> &qx, vector<double> &qy)
+{
+  mt19937_64 gen(12345);
+  uniform_real_distribution<double> u(0.0, 1.0);
+  qx.resize(NQUERY); qy.resize(NQUERY);
+  double x = 0.5*(NX - 1), y = 0.5*(NY - 1);
+  for (int k = 0; k < NQUERY; ++k) {
+    if (path) {
+      x += PATH_STEP*(2.0*u(gen) - 1.0);
+      y += PATH_STEP*(2.0*u(gen) - 1.0);
+      x = min(max(x, 0.0), NX - 1.0);
+      y = min(max(y, 0.0), NY - 1.0);
+    } else {
+      x = u(gen)*(NX - 1);
+      y = u(gen)*(NY - 1);
+    }
+    qx[k] = x; qy[k] = y;
+  }
+}
+
+
+/*--------------------------------------------------------------------
+  Run the queries and print the throughput. As in a Monte-Carlo code,
+  each query point depends on the previous result, so cache misses
+  cannot be overlapped by running ahead.
+--------------------------------------------------------------------*/
+template <class T> void run(const string &name, T &t,
+  const vector<double> &qx, const vector<double> &qy)
+{
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  double sum = 0.0;
+  double dep = 0.0;
+  for (int k = 0; k < NQUERY; ++k) {
+    double z = t.interp(qx[k] + dep, qy[k]);
+    dep = (z > 2.0) ? 1.0 : 0.0;
+    sum += z;
+  }
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  double sec = chrono::duration<double>(t1 - t0).count();
+  cout << "  " << name << ": " << NQUERY/sec*1.0e-6
+    << " Mquery/s  (checksum " << sum << ")\n";
+}
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  vector<double> x(NX), y(NY), z(size_t(NX)*NY);
+  for (int i = 0; i < NX; ++i) x[i] = i;
+  for (int j = 0; j < NY; ++j) y[j] = j;
+  for (int i = 0; i < NX; ++i)
+    for (int j = 0; j < NY; ++j)
+      z[size_t(i)*NY + j] = sin(0.01*i)*cos(0.013*j);
+
+  Table3D t_row;
+  t_row.init(x, y, z);
+  z.clear(); z.shrink_to_fit();
+
+  Table3DTiled t_tile;
+  t_tile.init(t_row);
+
+  cout << "Table " << NX << " x " << NY << ", "
+    << NQUERY << " queries\n";
+
+  vector<double> qx, qy;
+  const char *pattern[] = { "random", "path" };
+  for (int p = 0; p < 2; ++p) {
+    makeQueries(p == 1, qx, qy);
+    cout << pattern[p] << ":\n";
+    run("row-major", t_row, qx, qy);
+    run("tiled    ", t_tile, qx, qy);
+  }
+  return 0;
+}
+
+
+//====================================================================
@@ -1,238 +1,16 @@
-
 /*====================================================================
 
-  DEFINITION OF THE TABULATED FUNCTION OF TWO ARGUMENTS OBJECT:
-
-  The object loads and keeps the array of 3D real function.
+  TEST PROGRAM for the tabulated function of two arguments objects
+  (see table3d.h and table3d_stream.h).
 
   ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
     P.N.Lebedev Physical Institute of the Russian Academy of Science.
     E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
 
-  Last modified: November 11, 2020.
-
 ====================================================================*/
 
-//***** For testing. *************************************************
-#include <stdio.h>
-#include <stdlib.h>
-#include <fstream>
-#include <iostream>
-#include <complex>
-#include <string>
-#include <math.h>
-#include <sys/stat.h>
-#include <vector>
-#include <sstream>
-using namespace std;
-//*******************************************************************/
-
-
-class Table3D
-{
-  private: vector<double> a_x;          // Array of 1st argument.
-  private: vector<double> a_y;          // Array of 2nd argument.
-  private: vector<vector<double> > a_z; // Array of function values.
-  private: bool transpose;              // Flag to transpose result.
-
-
-  /*------------------------------------------------------------------
-    Constructor & Destructor.
-  ------------------------------------------------------------------*/
-  public: Table3D()
-    { clear(); }
-
-  public: ~Table3D()
-    { clear(); }
-
-
-  /*------------------------------------------------------------------
-    Clear object.
-  ------------------------------------------------------------------*/
-  public: void clear()
-  {
-    a_x.clear(); a_y.clear();
-    for(int i = 0; i < a_z.size(); ++i)
-      a_z[i].clear();
-    a_z.clear();
-    transpose = false;
-  }
-
-
-  /*------------------------------------------------------------------
-    Initialization by loading the data from file.
-  ------------------------------------------------------------------*/
-  public: void init(
-    string file_name)   // Name of file to load data.
-  {
-    clear();
-
-    struct stat st;
-    if(stat(file_name.c_str(), &st) != 0) {
-      cout << "File " << file_name << " not found!\n";
-      exit(0);
-    } else {
-      ifstream fin(file_name.c_str());
-      string s;
-
-      bool first_read = true;
-      vector<double> z0;
-      z0.clear();
-
-      int ix = 0;
-      int iy = 0;
-      int ifast = 0;
-
-      while (getline(fin, s))
-        if ( !s.empty() ) {     // Work with not empty string.
-
-          istringstream ss;
-          ss.str(s);
-
-          if (first_read) {               // First read.
-
-            double tmp;
-            ss >> tmp; a_x.push_back(tmp);
-            ss >> tmp; a_y.push_back(tmp);
-            ss >> tmp; z0.push_back(tmp);
-            first_read = false;
-
-          } else {                        // Ordinary read.
-
-            double xtmp; ss >> xtmp;
-            double ytmp; ss >> ytmp;
-            double ztmp; ss >> ztmp;
-
-            if (a_x[ix] == xtmp) {        // 2nd variable is fast.
-
-              ++iy;
-              ifast = 2;
-
-              if ( (a_y.size() - 1) < iy ) {
-                a_y.push_back(ytmp);
-              } else if (a_y[iy] != ytmp) {
-                cout << "Y grid in file " << file_name
-                  << " is corrupted!\n";
-                fin.close();
-                exit(0);
-              }
-
-              z0.push_back(ztmp);
-
-            } else if (a_y[iy] == ytmp) { // 1st variable is fast.
-
-              ++ix;
-              ifast = 1;
-
-              if ( (a_x.size() - 1) < ix ) {
-                a_x.push_back(xtmp);
-              } else if (a_x[ix] != xtmp) {
-                cout << "X grid in file " << file_name
-                  << " is corrupted!\n";
-                fin.close();
-                exit(0);
-              }
-
-              z0.push_back(ztmp);
-
-            } else if ( (a_x[ix] != xtmp) && (a_y[iy] != ytmp) )
-
-              if(a_y[0] == ytmp) {        // Change 1st slow variable.
-
-                a_z.push_back(z0);
-                z0.clear();
-                a_x.push_back(xtmp);
-                ++ix;
-                iy = 0;
-                z0.push_back(ztmp);
-
-              } else if (a_x[0] == xtmp) { // Change 2nd slow variable.
-                a_z.push_back(z0);
-                z0.clear();
-                a_y.push_back(ytmp);
-                ++iy;
-                ix = 0;
-                z0.push_back(ztmp);
-              } else {
-                cout << "Irregular grid in file " << file_name
-                  << "!\n";
-                fin.close();
-                exit(0);
-              }
-          }
-        }                       // Work with not empty string.
-
-      // Add last column of z-data.
-      a_z.push_back(z0);
-      z0.clear();
-
-      fin.close();
-
-      // Check the fast and slow arguments
-      // and set the index order in "a_z" array.
-      if (ifast == 1)
-        transpose = true;
-
-      if (ifast == 2)
-        transpose = false;
-
-      if (ifast == 0) {
-        cout << "No order in file " << file_name << "!\n";
-        exit(0);
-      }
-
-      // Check square form.
-      for (int i = 1; i < a_z.size(); ++i)
-        if (a_z[i].size() != a_z[0].size()) {
-          cout << "Not square matrix in " << file_name << "!\n";
-          cout << "Size of " << i << " is not equal to size of 0.";
-          exit(0);
-        }
-
-      /* Test output.
-      cout << "ifast = " << ifast 
-	    << "  transpose = " << transpose << "\n";
-      cout << "Z size = " << a_z.size() << "\n";
-      for(int i = 0; i < a_z.size(); ++i) cout << "  Z["
-        << i << "] size = " << a_z[i].size() << "\n"; // */
-
-    }
-  }
-
-
-  /*------------------------------------------------------------------
-    Array sizes.
-  ------------------------------------------------------------------*/
-  public: int getXNum() { return a_x.size(); }
-  public: int getYNum() { return a_y.size(); }
-
-  public: void getZnum(int &nx, int &ny) {
-    if(transpose)
-      { ny = a_z.size(); nx = a_z[0].size(); }
-    else
-      { nx = a_z.size(); ny = a_z[0].size(); }
-
-    return;
-  }
-
-
-  /*------------------------------------------------------------------
-    Get array values.
-  ------------------------------------------------------------------*/
-  public: double getX(int i) { return a_x[i]; }
-  public: double getY(int j) { return a_y[j]; }
-
-  public: double getZ(int i, int j)
-  {
-    if(transpose)
-      return a_z[j][i];
-    else
-      return a_z[i][j];
-  }
-
-
-}; //=================================================================
-
+#include "table3d.h"
+#include "table3d_stream.h"
 
 
 /*********************************************************************
@@ -296,6 +74,123 @@ int main(int argc, char **argv)
     cout << "\n";
   }
 
+
+  // --- Views of physically transposed table. -----------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  Table3D t3v;
+  t3v.init("dataT.dat", TABLE3D_X_SLOW);
+  t3v.getZnum(nx, ny);
+
+  cout << "Rows (contiguous = " << t3v.getRow(0).isContiguous() << "):\n";
+  for(int i = 0; i < nx; ++i) {
+    Table3DView row = t3v.getRow(i);
+    cout << "  z(" << i << ", *) =";
+    for(int j = 0; j < row.size(); ++j) cout << " " << row[j];
+    cout << "\n";
+  }
+
+  cout << "Columns (stride = " << t3v.getColumn(0).getStride() << "):\n";
+  for(int j = 0; j < ny; ++j) {
+    Table3DView col = t3v.getColumn(j);
+    cout << "  z(*, " << j << ") =";
+    for(int i = 0; i < col.size(); ++i) cout << " " << col[i];
+    cout << "\n";
+  }
+
+
+  // --- Tiled storage. ----------------------------------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  Table3DTiled t3t;
+  t3t.init(t3v);
+
+  cout << "Tiled table:\n";
+  for(int i = 0; i < nx; ++i) {
+    cout << "  z(" << i << ", *) =";
+    for(int j = 0; j < ny; ++j) cout << " " << t3t.getZ(i, j);
+    cout << "\n";
+  }
+
+  cout << "Interpolation at (2.5, 1.5): " << t3v.interp(2.5, 1.5)
+    << " (tiled " << t3t.interp(2.5, 1.5) << ")\n";
+
+
+  // --- Out-of-core tiles. ------------------------------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  table3dTextToTiles("dataT.dat", "dataT.tiles", 2);
+  Table3DStream t3s;
+  t3s.init("dataT.tiles", 0);
+
+  cout << "Streamed table:\n";
+  for(int i = 0; i < nx; ++i) {
+    cout << "  z(" << i << ", *) =";
+    for(int j = 0; j < ny; ++j) cout << " " << t3s.getZ(i, j);
+    cout << "\n";
+  }
+  cout << "Interpolation at (2.5, 1.5): " << t3s.interp(2.5, 1.5) << "\n";
+  cout << "Tiles read: " << t3s.getMissNum() << "\n";
+  t3s.clear();
+  remove("dataT.tiles");
+
+
+  // --- Several values per node. ------------------------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  Table3D t3k;
+  t3k.init("dataK.dat");
+  t3k.getZnum(nx, ny);
+  int nch = t3k.getChannelNum();
+  cout << "Channels: " << nch << "\n";
+
+  for(int i = 0; i < nx; ++i) {
+    for(int j = 0; j < ny; ++j) {
+      cout << t3k.getX(i) << " " << t3k.getY(j);
+      for(int c = 0; c < nch; ++c) cout << " " << t3k.getZ(i, j, c);
+      cout << "\n";
+    }
+    cout << "\n";
+  }
+
+  vector<double> zk(nch);
+  t3k.interp(1.5, 1.5, &zk[0]);
+  cout << "Interpolation at (1.5, 1.5):";
+  for(int c = 0; c < nch; ++c) cout << " " << zk[c];
+  cout << "\n";
+
+
+  // --- Inverse lookup and contours. --------------------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  double xz;
+  if (if2.inverseX(250.0, 2.5, xz))
+    cout << "z(x, 2.5) = 250 at x = " << xz << " (z = " << if2.interp(xz, 2.5) << ")\n";
+  if (!if2.inverseX(400.0, 2.5, xz))
+    cout << "z(x, 2.5) = 400 is out of the grid\n";
+
+  ThreadPool pool;
+  vector<double> seg;
+  if2.contour(250.0, seg, pool);
+  cout << "Contour z = 250:\n";
+  for(int s = 0; s < seg.size(); s += 4)
+    cout << "  (" << seg[s] << ", " << seg[s+1] << ") - (" << seg[s+2] << ", " << seg[s+3] << ")\n";
+
+
+  // --- Shared memory. ----------------------------------------------
+  cout << "\n---------------------------------------------------\n\n";
+
+  if2.publish("table3d_test");
+  Table3D t3m;
+  if (t3m.attach("table3d_test"))
+    cout << "Attached generation " << t3m.getGeneration()
+      << ": z(2.5, 1.5) = " << t3m.interp(2.5, 1.5) << "\n";
+  t3d.publish("table3d_test");
+  if (t3m.refresh())
+    cout << "Refreshed to generation " << t3m.getGeneration()
+      << ": z(2.5, 1.5) = " << t3m.interp(2.5, 1.5) << "\n";
+  Table3D::unpublish("table3d_test");
+
   return 0;
 }   // */
 
@@ -0,0 +1,1086 @@
+
+/*====================================================================
+
+  DEFINITION OF THE TABULATED FUNCTION OF TWO ARGUMENTS OBJECT:
+
+  The object loads and keeps the array of 3D real function.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+  Last modified: November 11, 2020.
+
+====================================================================*/
+
+#ifndef TABLE3D_H
+#define TABLE3D_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include "../zstream.h"
+#include "../uniform_axis.h"
+#include "../thread_pool.h"
+#include <new>
+using namespace std;
+
+
+/*--------------------------------------------------------------------
+  Storage order of the function values.
+--------------------------------------------------------------------*/
+const int TABLE3D_FILE_ORDER = 0;   // Keep the order of the file.
+const int TABLE3D_X_SLOW = 1;       // Rows z(i, *) are contiguous.
+const int TABLE3D_Y_SLOW = 2;       // Columns z(*, j) are contiguous.
+
+
+/*--------------------------------------------------------------------
+  Index "i" of the grid cell [a[i], a[i+1]] containing "v" for the
+  ascending array "a" of at least two points. Values outside the grid
+  are referred to the boundary cells. On the uniform axis "u" of the
+  array the cell is found in O(1), otherwise by bisection.
+--------------------------------------------------------------------*/
+inline int table3dLocate(const vector<double> &a, const UniformAxis &u, double v)
+{
+  if (u.isUniform()) return u.locate(v, &a[0]);
+  int i = upper_bound(a.begin() + 1, a.end() - 1, v) - a.begin() - 1;
+  return i;
+}
+
+
+/*--------------------------------------------------------------------
+  Table published in the shared memory (see Table3D::publish): the
+  header, then the arrays of the 1st and 2nd arguments and the values
+  in their storage order. The segment of each generation is named
+  "<name>.<generation>"; the segment "<name>" keeps the current one.
+--------------------------------------------------------------------*/
+const char TABLE3D_SHM_MAGIC[8] = "TABLE3D";
+
+struct Table3DShmHeader
+{
+  char magic[8];    // TABLE3D_SHM_MAGIC.
+  int64_t nx;       // Number of 1st arguments.
+  int64_t ny;       // Number of 2nd arguments.
+  int64_t nch;      // Number of channels.
+  int64_t order;    // Storage order of the values.
+};
+
+struct Table3DShmControl
+{
+  std::atomic<uint64_t> gen;   // Current generation, 0 if none.
+};
+
+
+/*--------------------------------------------------------------------
+  Name of the shared memory segment of the table "name" for the
+  generation "gen", of the control segment for zero generation.
+--------------------------------------------------------------------*/
+inline string table3dShmName(const string &name, uint64_t gen = 0)
+{
+  string res = (name.compare(0, 1, "/") == 0) ? name : "/" + name;
+  if (gen > 0) res += "." + to_string(gen);
+  return res;
+}
+
+
+/*--------------------------------------------------------------------
+  Read-only view of a row or a column of the table. Values are
+  shared with the table, elements are "stride" doubles apart.
+--------------------------------------------------------------------*/
+class Table3DView
+{
+  private: const double *p;   // First element.
+  private: int n;             // Number of elements.
+  private: size_t stride;     // Distance between elements.
+
+  public: Table3DView(const double *p_, int n_, size_t stride_)
+    : p(p_), n(n_), stride(stride_) {}
+
+  public: int size() const { return n; }
+  public: size_t getStride() const { return stride; }
+  public: bool isContiguous() const { return stride == 1; }
+  public: const double *data() const { return p; }
+
+  public: double operator[](int k) const { return p[k*stride]; }
+};
+
+
+class Table3D
+{
+  private: vector<double> a_x;  // Array of 1st argument.
+  private: vector<double> a_y;  // Array of 2nd argument.
+  private: vector<double> a_z;  // Flat array of function values.
+  private: UniformAxis u_x;     // Uniform axis of 1st argument, if any.
+  private: UniformAxis u_y;     // Uniform axis of 2nd argument, if any.
+  private: int nch;             // Number of values (channels) per node.
+  private: int order;           // Storage order of "a_z".
+  private: size_t sx;           // Stride of "a_z" along 1st argument.
+  private: size_t sy;           // Stride of "a_z" along 2nd argument.
+  private: vector<signed char> inv_dir;  // Directions of z_c(*, j) along 1st argument at j*nch + c.
+  private: const double *p_z;            // Values: "a_z" or the shared segment.
+  private: void *shm_map;                // Mapped shared segment, if attached.
+  private: size_t shm_size;              // Size of "shm_map".
+  private: const Table3DShmControl *shm_ctl;  // Mapped control segment.
+  private: uint64_t shm_gen;             // Generation of "shm_map".
+  private: string shm_name;              // Name of the attached table.
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor. A copy keeps its own values, also of an
+    attached table.
+  ------------------------------------------------------------------*/
+  public: Table3D()
+    { shm_map = NULL; shm_ctl = NULL; clear(); }
+
+  public: Table3D(const Table3D &t)
+    { shm_map = NULL; shm_ctl = NULL; clear(); copy(t); }
+
+  public: ~Table3D()
+    { clear(); }
+
+  public: Table3D &operator=(const Table3D &t)
+  {
+    if (this != &t) { clear(); copy(t); }
+    return *this;
+  }
+
+
+  /*------------------------------------------------------------------
+    Clear object.
+  ------------------------------------------------------------------*/
+  public: void clear()
+  {
+    detach();
+    a_x.clear(); a_y.clear(); a_z.clear();
+    u_x.clear(); u_y.clear();
+    inv_dir.clear();
+    p_z = NULL;
+    nch = 0;
+    order = TABLE3D_X_SLOW;
+    sx = 0; sy = 0;
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization by loading the data from file "x y z1 ... zk".
+    Values are stored in the "req_order", physically transposed if
+    the file order differs from it. All k values of a node are kept
+    next to each other. Errors of the file are fatal.
+  ------------------------------------------------------------------*/
+  public: void init(
+    string file_name,                   // Name of file to load data.
+    int req_order = TABLE3D_FILE_ORDER) // Storage order required.
+  {
+    string err;
+    if (!readFile(file_name, req_order, true, err)) {
+      cout << err << "\n";
+      exit(0);
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization as init() for the callers that can not exit:
+    returns false with the message "err" on an error of the file,
+    the table is left empty.
+  ------------------------------------------------------------------*/
+  public: bool load(
+    string file_name,   // Name of file to load data.
+    int req_order,      // Storage order required.
+    string &err)        // Error message.
+    { return readFile(file_name, req_order, true, err); }
+
+
+  /*------------------------------------------------------------------
+    Initialization of the grid only: arguments and the file order are
+    loaded and checked, function values are skipped.
+  ------------------------------------------------------------------*/
+  public: void initGrid(
+    string file_name)   // Name of file to load grid.
+  {
+    string err;
+    if (!readFile(file_name, TABLE3D_FILE_ORDER, false, err)) {
+      cout << err << "\n";
+      exit(0);
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Load the data from file. Returns false with the message "err"
+    and the table cleared on an error.
+  ------------------------------------------------------------------*/
+  private: bool readFile(
+    string file_name,   // Name of file to load data.
+    int req_order,      // Storage order required.
+    bool keep_z,        // Flag to keep function values.
+    string &err)        // Error message.
+  {
+    clear();
+
+    struct stat st;
+    if(stat(file_name.c_str(), &st) != 0) {
+      return loadError("File " + file_name + " not found!", err);
+    } else {
+      DataInputStream fin(file_name);
+      string s;
+
+      bool first_read = true;
+      int nslow = 0;    // Number of completed lines along slow argument.
+      int nfast = 0;    // Length of the first line along fast argument.
+      int nline = 0;    // Length of the current line.
+
+      vector<double> zrow;  // Values of the current node.
+
+      int ix = 0;
+      int iy = 0;
+      int ifast = 0;
+
+      while (getline(fin, s))
+        if (s.find_first_not_of(" \t\r") != string::npos) {
+                                // Work with not empty string.
+          istringstream ss;
+          ss.str(s);
+
+          if (first_read) {               // First read.
+
+            double tmp;
+            ss >> tmp; a_x.push_back(tmp);
+            ss >> tmp; a_y.push_back(tmp);
+            if (!readValues(ss, zrow, file_name, err)) return false;
+            if (keep_z) a_z.insert(a_z.end(), zrow.begin(), zrow.end());
+            nline = 1;
+            first_read = false;
+
+          } else {                        // Ordinary read.
+
+            double xtmp; ss >> xtmp;
+            double ytmp; ss >> ytmp;
+            if (!readValues(ss, zrow, file_name, err)) return false;
+
+            if (a_x[ix] == xtmp) {        // 2nd variable is fast.
+
+              ++iy;
+              ifast = 2;
+
+              if ( (a_y.size() - 1) < iy ) {
+                a_y.push_back(ytmp);
+              } else if (a_y[iy] != ytmp) {
+                return loadError("Y grid in file " + file_name
+                  + " is corrupted!", err);
+              }
+
+              if (keep_z) a_z.insert(a_z.end(), zrow.begin(), zrow.end());
+              ++nline;
+
+            } else if (a_y[iy] == ytmp) { // 1st variable is fast.
+
+              ++ix;
+              ifast = 1;
+
+              if ( (a_x.size() - 1) < ix ) {
+                a_x.push_back(xtmp);
+              } else if (a_x[ix] != xtmp) {
+                return loadError("X grid in file " + file_name
+                  + " is corrupted!", err);
+              }
+
+              if (keep_z) a_z.insert(a_z.end(), zrow.begin(), zrow.end());
+              ++nline;
+
+            } else if ( (a_x[ix] != xtmp) && (a_y[iy] != ytmp) )
+
+              if(a_y[0] == ytmp) {        // Change 1st slow variable.
+
+                if (nslow == 0) nfast = nline;
+                if (nline != nfast)
+                  return loadError("Not square matrix in " + file_name
+                    + "!\nSize of " + to_string(nslow)
+                    + " is not equal to size of 0.", err);
+                ++nslow;
+                a_x.push_back(xtmp);
+                ++ix;
+                iy = 0;
+                if (keep_z)
+                  a_z.insert(a_z.end(), zrow.begin(), zrow.end());
+                nline = 1;
+
+              } else if (a_x[0] == xtmp) { // Change 2nd slow variable.
+
+                if (nslow == 0) nfast = nline;
+                if (nline != nfast)
+                  return loadError("Not square matrix in " + file_name
+                    + "!\nSize of " + to_string(nslow)
+                    + " is not equal to size of 0.", err);
+                ++nslow;
+                a_y.push_back(ytmp);
+                ++iy;
+                ix = 0;
+                if (keep_z)
+                  a_z.insert(a_z.end(), zrow.begin(), zrow.end());
+                nline = 1;
+
+              } else {
+                return loadError("Irregular grid in file " + file_name
+                  + "!", err);
+              }
+          }
+        }                       // Work with not empty string.
+
+      if (!fin.error().empty())
+        return loadError(fin.error(), err);
+      fin.close();
+
+      // Check the last line along the slow argument.
+      if ( (nslow > 0) && (nline != nfast) )
+        return loadError("Not square matrix in " + file_name + "!\nSize of "
+          + to_string(nslow) + " is not equal to size of 0.", err);
+
+      // Check the fast and slow arguments
+      // and set the index order in "a_z" array.
+      if (ifast == 0)
+        return loadError("No order in file " + file_name + "!", err);
+      order = (ifast == 1) ? TABLE3D_Y_SLOW : TABLE3D_X_SLOW;
+      setStrides();
+      p_z = a_z.data();
+      u_x.init(a_x);
+      u_y.init(a_y);
+
+      if ( keep_z && (req_order != TABLE3D_FILE_ORDER)
+        && (req_order != order) )
+        transposeStorage();
+      if (keep_z) initInverse();
+
+      /* Test output.
+      cout << "ifast = " << ifast << "  order = " << order << "\n";
+      cout << "Z size = " << a_z.size() << "\n"; // */
+
+      err.clear();
+      return true;
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Clear the table on the error "msg" of loading. Returns false.
+  ------------------------------------------------------------------*/
+  private: bool loadError(const string &msg, string &err)
+  {
+    clear();
+    err = msg;
+    return false;
+  }
+
+
+  /*------------------------------------------------------------------
+    Read values of all channels from the rest of line. The number of
+    channels is set by the first line and checked for the others.
+    Returns false with the message "err" if the number differs.
+  ------------------------------------------------------------------*/
+  private: bool readValues(
+    istringstream &ss,        // Stream of the line.
+    vector<double> &z,        // Result values.
+    const string &file_name,  // Name of file for error message.
+    string &err)              // Error message.
+  {
+    z.clear();
+    double tmp;
+    while (ss >> tmp) z.push_back(tmp);
+    if (nch == 0) nch = z.size();
+    if ( (nch == 0) || (z.size() != nch) )
+      return loadError("Number of values in file " + file_name
+        + " is not constant!", err);
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Physically transpose the values to the opposite storage order.
+    Done by square blocks to keep both source and target in cache.
+    An attached table gets its own transposed copy.
+  ------------------------------------------------------------------*/
+  public: void transposeStorage()
+  {
+    int nx = a_x.size();
+    int ny = a_y.size();
+    const int nb = 32;
+    vector<double> tmp(size_t(nx)*ny*nch);
+    size_t tx = (order == TABLE3D_X_SLOW) ? nch : size_t(ny)*nch;
+    size_t ty = (order == TABLE3D_X_SLOW) ? size_t(nx)*nch : nch;
+    for (int ib = 0; ib < nx; ib += nb)
+      for (int jb = 0; jb < ny; jb += nb)
+        for (int i = ib; i < min(ib + nb, nx); ++i)
+          for (int j = jb; j < min(jb + nb, ny); ++j)
+            for (int c = 0; c < nch; ++c)
+              tmp[i*tx + j*ty + c] = p_z[i*sx + j*sy + c];
+    detach();
+    a_z.swap(tmp);
+    p_z = a_z.data();
+    order = (order == TABLE3D_X_SLOW) ? TABLE3D_Y_SLOW : TABLE3D_X_SLOW;
+    setStrides();
+  }
+
+
+  /*------------------------------------------------------------------
+    Set strides of "a_z" for the current storage order.
+  ------------------------------------------------------------------*/
+  private: void setStrides()
+  {
+    if (order == TABLE3D_X_SLOW)
+      { sx = a_y.size()*nch; sy = nch; }
+    else
+      { sx = nch; sy = a_x.size()*nch; }
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization by the given arrays. Values "z" are ordered with
+    the 2nd argument fast and channels fastest:
+    z_c(i, j) = z[(i*ny + j)*k + c].
+  ------------------------------------------------------------------*/
+  public: void init(
+    const vector<double> &x,            // Array of 1st argument.
+    const vector<double> &y,            // Array of 2nd argument.
+    const vector<double> &z,            // Array of function values.
+    int req_order = TABLE3D_X_SLOW,     // Storage order required.
+    int k = 1)                          // Number of channels.
+  {
+    clear();
+    if (z.size() != x.size()*y.size()*k) {
+      cout << "Table3D: size of values is not equal to nx*ny*k!\n";
+      exit(0);
+    }
+    a_x = x; a_y = y; a_z = z;
+    p_z = a_z.data();
+    u_x.init(a_x);
+    u_y.init(a_y);
+    nch = k;
+    order = TABLE3D_X_SLOW;
+    setStrides();
+    if (req_order == TABLE3D_Y_SLOW)
+      transposeStorage();
+    initInverse();
+  }
+
+
+  /*------------------------------------------------------------------
+    Array sizes.
+  ------------------------------------------------------------------*/
+  public: int getXNum() { return a_x.size(); }
+  public: int getYNum() { return a_y.size(); }
+
+  public: void getZnum(int &nx, int &ny) {
+    nx = a_x.size();
+    ny = a_y.size();
+    return;
+  }
+
+  public: int getOrder() { return order; }
+  public: int getChannelNum() { return nch; }
+
+
+  /*------------------------------------------------------------------
+    Get array values.
+  ------------------------------------------------------------------*/
+  public: double getX(int i) { return a_x[i]; }
+  public: double getY(int j) { return a_y[j]; }
+
+  // Arrays of the arguments.
+  public: const vector<double> &getXArray() { return a_x; }
+  public: const vector<double> &getYArray() { return a_y; }
+
+  public: double getZ(int i, int j, int c = 0)
+    { return p_z[i*sx + j*sy + c]; }
+
+  // Values of all channels of the node.
+  public: const double *getZAll(int i, int j)
+    { return &p_z[i*sx + j*sy]; }
+
+
+  /*------------------------------------------------------------------
+    Views of the values z_c(i, *) at fixed 1st argument and z_c(*, j)
+    at fixed 2nd argument. Contiguous for a single channel in
+    TABLE3D_X_SLOW and TABLE3D_Y_SLOW order respectively, strided
+    otherwise.
+  ------------------------------------------------------------------*/
+  public: Table3DView getRow(int i, int c = 0)
+    { return Table3DView(&p_z[i*sx + c], a_y.size(), sy); }
+
+  public: Table3DView getColumn(int j, int c = 0)
+    { return Table3DView(&p_z[j*sy + c], a_x.size(), sx); }
+
+
+  /*------------------------------------------------------------------
+    Bilinear interpolation. Arguments outside the grid are
+    extrapolated from the boundary cell.
+  ------------------------------------------------------------------*/
+  public: double interp(double x, double y, int c = 0)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    const double *p = &p_z[i*sx + j*sy + c];
+    return (1.0 - tx)*((1.0 - ty)*p[0] + ty*p[sy])
+      + tx*((1.0 - ty)*p[sx] + ty*p[sx + sy]);
+  }
+
+  // Interpolation of all channels at once into "res".
+  public: void interp(double x, double y, double *res)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    const double *p = &p_z[i*sx + j*sy];
+    double w00 = (1.0 - tx)*(1.0 - ty), w01 = (1.0 - tx)*ty;
+    double w10 = tx*(1.0 - ty), w11 = tx*ty;
+    for (int c = 0; c < nch; ++c)
+      res[c] = w00*p[c] + w01*p[sy + c] + w10*p[sx + c] + w11*p[sx + sy + c];
+  }
+
+
+  /*------------------------------------------------------------------
+    Directions of the values z_c(*, j) of all channels along the 1st
+    argument at every node of the 2nd argument for the inverse
+    lookup: 1 not decreasing, -1 not increasing, 0 not monotonic.
+    Found once as the values are set, in one pass in their storage
+    order, so that queries only read them.
+  ------------------------------------------------------------------*/
+  private: void initInverse()
+  {
+    int nx = a_x.size();
+    int ny = a_y.size();
+    size_t n = size_t(ny)*nch;
+    vector<char> up(n, 1), down(n, 1);
+    bool x_slow = (order == TABLE3D_X_SLOW);
+    int nslow = x_slow ? nx : ny;
+    int nfast = x_slow ? ny : nx;
+    for (int is = 0; is < nslow; ++is)
+      for (int jf = 0; jf < nfast; ++jf) {
+        int i = x_slow ? is : jf;
+        int j = x_slow ? jf : is;
+        if (i == 0) continue;
+        const double *p = &p_z[i*sx + j*sy];
+        const double *q = p - sx;
+        for (int c = 0; c < nch; ++c) {
+          double d = p[c] - q[c];
+          if (d < 0.0) up[size_t(j)*nch + c] = 0;
+          if (d > 0.0) down[size_t(j)*nch + c] = 0;
+        }
+      }
+    inv_dir.resize(n);
+    for (size_t k = 0; k < n; ++k)
+      inv_dir[k] = up[k] ? 1 : (down[k] ? -1 : 0);
+  }
+
+
+  /*------------------------------------------------------------------
+    Inverse lookup: the 1st argument "x" at which the interpolation
+    of the channel "c" at the 2nd argument "y" takes the value "z".
+    Between two monotonic lines of the grid the cell is found by
+    bisection in O(log n), otherwise the first cell crossing "z" in
+    order of "x" is found by a scan. Returns false if the value is
+    not taken within the grid of the 1st argument.
+  ------------------------------------------------------------------*/
+  public: bool inverseX(double z, double y, double &x, int c = 0)
+  {
+    int nx = a_x.size();
+    int j = table3dLocate(a_y, u_y, y);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    const double *p = &p_z[j*sy + c];
+    auto val = [&](int i) { return (1.0 - ty)*p[i*sx] + ty*p[i*sx + sy]; };
+
+    int i = -1;
+    const signed char *dir = &inv_dir[size_t(j)*nch + c];
+    int d = ( (ty >= 0.0) && (ty <= 1.0) && (dir[0] == dir[nch]) ) ? dir[0] : 0;
+    if (d != 0) {
+      if ( (d*(z - val(0)) < 0.0) || (d*(val(nx - 1) - z) < 0.0) ) return false;
+      int lo = 0, hi = nx - 1;
+      while (hi - lo > 1) {
+        int mid = (lo + hi)/2;
+        if (d*(val(mid) - z) < 0.0) lo = mid; else hi = mid;
+      }
+      i = lo;
+    } else {
+      for (int k = 0; (k < nx - 1) && (i < 0); ++k)
+        if ((val(k) - z)*(val(k + 1) - z) <= 0.0) i = k;
+      if (i < 0) return false;
+    }
+    double a = val(i), b = val(i + 1);
+    double t = (b != a) ? (z - a)/(b - a) : 0.0;
+    x = a_x[i] + t*(a_x[i+1] - a_x[i]);
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Contour lines z_c(x, y) = z of the channel "c" by marching
+    squares: segments "x1 y1 x2 y2" appended to "seg" in order of the
+    cells. Bands of cells along the 1st argument are traced in
+    parallel. Saddle cells are resolved by the mean of the corners.
+  ------------------------------------------------------------------*/
+  public: void contour(double z, vector<double> &seg, ThreadPool &pool, int c = 0)
+  {
+    int nx = a_x.size();
+    int ny = a_y.size();
+    if ( (nx < 2) || (ny < 2) ) return;
+    int nband = min(nx - 1, 4*pool.size());
+    vector<vector<double> > part(nband);
+    pool.parallelFor(nband, [&](int b) {
+      vector<double> &s = part[b];
+      for (int i = b*(nx - 1)/nband; i < (b + 1)*(nx - 1)/nband; ++i)
+        for (int j = 0; j < ny - 1; ++j) {
+          // Corners counterclockwise from (i, j); edge k joins corners k and k+1.
+          const double *p = &p_z[i*sx + j*sy + c];
+          double v[4] = { p[0], p[sx], p[sx + sy], p[sy] };
+          int up = 0;
+          for (int k = 0; k < 4; ++k)
+            if (v[k] >= z) up |= 1 << k;
+          if ( (up == 0) || (up == 15) ) continue;
+          double cx[4] = { a_x[i], a_x[i+1], a_x[i+1], a_x[i] };
+          double cy[4] = { a_y[j], a_y[j], a_y[j+1], a_y[j+1] };
+          double ex[4], ey[4];
+          int e[4], ne = 0;
+          for (int k = 0; k < 4; ++k) {
+            int k1 = (k + 1) & 3;
+            if ( ((up >> k) & 1) == ((up >> k1) & 1) ) continue;
+            double t = (z - v[k])/(v[k1] - v[k]);
+            ex[k] = cx[k] + t*(cx[k1] - cx[k]);
+            ey[k] = cy[k] + t*(cy[k1] - cy[k]);
+            e[ne++] = k;
+          }
+          // Saddle: corners of the class of the center are joined through it.
+          if ( (ne == 4) && ((0.25*(v[0] + v[1] + v[2] + v[3]) >= z) != bool(up & 1)) )
+            { e[0] = 3; e[1] = 0; e[2] = 1; e[3] = 2; }
+          for (int q = 0; q < ne; q += 2) {
+            s.push_back(ex[e[q]]); s.push_back(ey[e[q]]);
+            s.push_back(ex[e[q+1]]); s.push_back(ey[e[q+1]]);
+          }
+        }
+    });
+    for (int b = 0; b < nband; ++b)
+      seg.insert(seg.end(), part[b].begin(), part[b].end());
+  }
+
+
+  /*------------------------------------------------------------------
+    Publish the table in the shared memory (see shm_open) under the
+    "name", for other processes to attach it read-only without a
+    copy. The new generation is written to a segment of its own and
+    made current by one atomic store, then the previous one is
+    unlinked: attached processes keep it until their refresh(). One
+    publisher per name. Returns false on an error.
+  ------------------------------------------------------------------*/
+  public: bool publish(const string &name)
+  {
+    int fd = shm_open(table3dShmName(name).c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if ( (fstat(fd, &st) != 0) || ( (st.st_size < (off_t) sizeof(Table3DShmControl))
+      && (ftruncate(fd, sizeof(Table3DShmControl)) != 0) ) ) {
+      close(fd);
+      return false;
+    }
+    void *pc = mmap(NULL, sizeof(Table3DShmControl), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pc == MAP_FAILED) return false;
+    Table3DShmControl *ctl = (Table3DShmControl *) pc;
+    uint64_t gen = ctl->gen.load(std::memory_order_acquire);
+
+    // New generation aside.
+    string seg_name = table3dShmName(name, gen + 1);
+    size_t nx = a_x.size(), ny = a_y.size(), nz = nx*ny*nch;
+    size_t size = sizeof(Table3DShmHeader) + (nx + ny + nz)*sizeof(double);
+    fd = shm_open(seg_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *p = MAP_FAILED;
+    if ( (fd >= 0) && (ftruncate(fd, size) == 0) )
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (fd >= 0) close(fd);
+    if (p == MAP_FAILED) {
+      shm_unlink(seg_name.c_str());
+      munmap(pc, sizeof(Table3DShmControl));
+      return false;
+    }
+    Table3DShmHeader *h = (Table3DShmHeader *) p;
+    memcpy(h->magic, TABLE3D_SHM_MAGIC, sizeof(h->magic));
+    h->nx = nx; h->ny = ny; h->nch = nch; h->order = order;
+    double *v = (double *) (h + 1);
+    if (nx > 0) memcpy(v, &a_x[0], nx*sizeof(double));
+    if (ny > 0) memcpy(v + nx, &a_y[0], ny*sizeof(double));
+    if (nz > 0) memcpy(v + nx + ny, p_z, nz*sizeof(double));
+    munmap(p, size);
+
+    // Swap generations.
+    ctl->gen.store(gen + 1, std::memory_order_release);
+    munmap(pc, sizeof(Table3DShmControl));
+    if (gen > 0) shm_unlink(table3dShmName(name, gen).c_str());
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Remove the table "name" from the shared memory. Attached
+    processes keep their mappings.
+  ------------------------------------------------------------------*/
+  public: static void unpublish(const string &name)
+  {
+    int fd = shm_open(table3dShmName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return;
+    void *pc = mmap(NULL, sizeof(Table3DShmControl), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pc != MAP_FAILED) {
+      uint64_t gen = ((const Table3DShmControl *) pc)->gen.load(std::memory_order_acquire);
+      if (gen > 0) shm_unlink(table3dShmName(name, gen).c_str());
+      munmap(pc, sizeof(Table3DShmControl));
+    }
+    shm_unlink(table3dShmName(name).c_str());
+  }
+
+
+  /*------------------------------------------------------------------
+    Attach the current generation of the table "name" published in
+    the shared memory. Values are mapped read-only and shared by all
+    attached processes; only the arguments are copied. Returns false
+    if there is no such table.
+  ------------------------------------------------------------------*/
+  public: bool attach(const string &name)
+  {
+    clear();
+    int fd = shm_open(table3dShmName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void *pc = MAP_FAILED;
+    if ( (fstat(fd, &st) == 0) && (st.st_size >= (off_t) sizeof(Table3DShmControl)) )
+      pc = mmap(NULL, sizeof(Table3DShmControl), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pc == MAP_FAILED) return false;
+    shm_ctl = (const Table3DShmControl *) pc;
+    shm_name = name;
+    if (!mapGeneration()) {
+      clear();
+      return false;
+    }
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Switch the attached table to the current generation if a new one
+    has been published. Returns true if the table has been switched.
+    Views and pointers to the values of the old generation become
+    invalid; not to be called during queries to the table.
+  ------------------------------------------------------------------*/
+  public: bool refresh()
+  {
+    if ( (shm_ctl == NULL) || (shm_ctl->gen.load(std::memory_order_acquire) == shm_gen) )
+      return false;
+    return mapGeneration();
+  }
+
+
+  // Generation of the attached table, 0 for own values.
+  public: uint64_t getGeneration() { return (shm_map != NULL) ? shm_gen : 0; }
+
+
+  /*------------------------------------------------------------------
+    Map the current generation of the attached table. A generation
+    replaced and unlinked between reading its number and opening it
+    is skipped for the next one.
+  ------------------------------------------------------------------*/
+  private: bool mapGeneration()
+  {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+      uint64_t gen = shm_ctl->gen.load(std::memory_order_acquire);
+      if (gen == 0) return false;
+      int fd = shm_open(table3dShmName(shm_name, gen).c_str(), O_RDONLY, 0);
+      if (fd < 0) continue;
+      struct stat st;
+      void *p = MAP_FAILED;
+      if ( (fstat(fd, &st) == 0) && (st.st_size >= (off_t) sizeof(Table3DShmHeader)) )
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      close(fd);
+      if (p == MAP_FAILED) return false;
+      const Table3DShmHeader *h = (const Table3DShmHeader *) p;
+      size_t nx = h->nx, ny = h->ny, nz = nx*ny*h->nch;
+      if ( (memcmp(h->magic, TABLE3D_SHM_MAGIC, sizeof(h->magic)) != 0) || (nx < 2) || (ny < 2)
+        || ((size_t) st.st_size < sizeof(Table3DShmHeader) + (nx + ny + nz)*sizeof(double)) ) {
+        munmap(p, st.st_size);
+        return false;
+      }
+      if (shm_map != NULL) munmap(shm_map, shm_size);
+      shm_map = p;
+      shm_size = st.st_size;
+      shm_gen = gen;
+      const double *v = (const double *) (h + 1);
+      a_x.assign(v, v + nx);
+      a_y.assign(v + nx, v + nx + ny);
+      a_z.clear();
+      p_z = v + nx + ny;
+      u_x.init(a_x);
+      u_y.init(a_y);
+      nch = h->nch;
+      order = h->order;
+      setStrides();
+      initInverse();
+      return true;
+    }
+    return false;
+  }
+
+
+  /*------------------------------------------------------------------
+    Unmap the shared segments of an attached table.
+  ------------------------------------------------------------------*/
+  private: void detach()
+  {
+    if (shm_map != NULL) munmap(shm_map, shm_size);
+    if (shm_ctl != NULL) munmap((void *) shm_ctl, sizeof(Table3DShmControl));
+    shm_map = NULL; shm_size = 0;
+    shm_ctl = NULL; shm_gen = 0;
+    shm_name.clear();
+  }
+
+
+  /*------------------------------------------------------------------
+    Copy of the table "t" with own values.
+  ------------------------------------------------------------------*/
+  private: void copy(const Table3D &t)
+  {
+    a_x = t.a_x; a_y = t.a_y;
+    u_x = t.u_x; u_y = t.u_y;
+    nch = t.nch; order = t.order;
+    sx = t.sx; sy = t.sy;
+    inv_dir = t.inv_dir;
+    if (t.shm_map != NULL)
+      a_z.assign(t.p_z, t.p_z + a_x.size()*a_y.size()*nch);
+    else
+      a_z = t.a_z;
+    p_z = a_z.data();
+  }
+
+
+
+}; //=================================================================
+
+
+/*--------------------------------------------------------------------
+  Allocator placing large arrays on transparent huge pages. Blocks
+  from TABLE3D_HUGE_PAGE are mapped aligned to the huge page and
+  advised to the kernel, smaller ones are aligned to a cache line.
+--------------------------------------------------------------------*/
+const size_t TABLE3D_HUGE_PAGE = 2*1024*1024;
+const size_t TABLE3D_CACHE_LINE = 64;
+
+template <class T> class HugePageAllocator
+{
+  public: typedef T value_type;
+
+  public: HugePageAllocator() {}
+  public: template <class U> HugePageAllocator(const HugePageAllocator<U> &) {}
+
+  public: T *allocate(size_t n)
+  {
+    size_t bytes = n*sizeof(T);
+    if (bytes < TABLE3D_HUGE_PAGE) {
+      void *p;
+      if (posix_memalign(&p, TABLE3D_CACHE_LINE, bytes) != 0)
+        throw bad_alloc();
+      return static_cast<T *>(p);
+    }
+
+    // Map with a spare huge page and trim to the aligned block.
+    bytes = roundBytes(bytes);
+    size_t map_bytes = bytes + TABLE3D_HUGE_PAGE;
+    void *m = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m == MAP_FAILED)
+      throw bad_alloc();
+    char *base = static_cast<char *>(m);
+    char *p = reinterpret_cast<char *>(
+      (reinterpret_cast<size_t>(base) + TABLE3D_HUGE_PAGE - 1)
+      & ~(TABLE3D_HUGE_PAGE - 1));
+    if (p > base) munmap(base, p - base);
+    if (base + map_bytes > p + bytes)
+      munmap(p + bytes, base + map_bytes - (p + bytes));
+#ifdef MADV_HUGEPAGE
+    madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<T *>(p);
+  }
+
+  public: void deallocate(T *p, size_t n)
+  {
+    size_t bytes = n*sizeof(T);
+    if (bytes < TABLE3D_HUGE_PAGE)
+      free(p);
+    else
+      munmap(p, roundBytes(bytes));
+  }
+
+  private: static size_t roundBytes(size_t bytes)
+    { return (bytes + TABLE3D_HUGE_PAGE - 1) & ~(TABLE3D_HUGE_PAGE - 1); }
+};
+
+template <class T, class U>
+bool operator==(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+  { return true; }
+
+template <class T, class U>
+bool operator!=(const HugePageAllocator<T> &, const HugePageAllocator<U> &)
+  { return false; }
+
+
+/*--------------------------------------------------------------------
+  Tabulated function of two arguments with cache-blocked storage for
+  scattered queries. Values are kept in square tiles of TABLE3D_TILE
+  nodes per side, one tile row per cache line for a single channel,
+  tiles follow each other along the 2nd argument. A node and its neighbours thus share
+  one or two cache lines and one page instead of lying a whole row
+  apart.
+--------------------------------------------------------------------*/
+const int TABLE3D_TILE_LOG = 3;
+const int TABLE3D_TILE = 1 << TABLE3D_TILE_LOG;
+
+class Table3DTiled
+{
+  private: vector<double> a_x;  // Array of 1st argument.
+  private: vector<double> a_y;  // Array of 2nd argument.
+  private: vector<double, HugePageAllocator<double> > a_z;
+                                // Tiled array of function values.
+  private: UniformAxis u_x;     // Uniform axis of 1st argument, if any.
+  private: UniformAxis u_y;     // Uniform axis of 2nd argument, if any.
+  private: int nch;             // Number of values (channels) per node.
+  private: int ntj;             // Number of tiles along 2nd argument.
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: Table3DTiled()
+    { clear(); }
+
+  public: ~Table3DTiled()
+    { clear(); }
+
+
+  /*------------------------------------------------------------------
+    Clear object.
+  ------------------------------------------------------------------*/
+  public: void clear()
+  {
+    a_x.clear(); a_y.clear(); a_z.clear();
+    u_x.clear(); u_y.clear();
+    nch = 0; ntj = 0;
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization by re-tiling the loaded table.
+  ------------------------------------------------------------------*/
+  public: void init(Table3D &t)
+  {
+    clear();
+    int nx, ny;
+    t.getZnum(nx, ny);
+    for (int i = 0; i < nx; ++i) a_x.push_back(t.getX(i));
+    for (int j = 0; j < ny; ++j) a_y.push_back(t.getY(j));
+    u_x.init(a_x);
+    u_y.init(a_y);
+
+    nch = t.getChannelNum();
+    int nti = (nx + TABLE3D_TILE - 1) >> TABLE3D_TILE_LOG;
+    ntj = (ny + TABLE3D_TILE - 1) >> TABLE3D_TILE_LOG;
+    a_z.assign(size_t(nti)*ntj*TABLE3D_TILE*TABLE3D_TILE*nch, 0.0);
+    for (int i = 0; i < nx; ++i)
+      for (int j = 0; j < ny; ++j) {
+        const double *p = t.getZAll(i, j);
+        for (int c = 0; c < nch; ++c)
+          a_z[index(i, j) + c] = p[c];
+      }
+  }
+
+
+  /*------------------------------------------------------------------
+    Array sizes.
+  ------------------------------------------------------------------*/
+  public: int getXNum() { return a_x.size(); }
+  public: int getYNum() { return a_y.size(); }
+  public: int getChannelNum() { return nch; }
+
+
+  /*------------------------------------------------------------------
+    Get array values.
+  ------------------------------------------------------------------*/
+  public: double getX(int i) { return a_x[i]; }
+  public: double getY(int j) { return a_y[j]; }
+
+  public: double getZ(int i, int j, int c = 0)
+    { return a_z[index(i, j) + c]; }
+
+
+  /*------------------------------------------------------------------
+    Bilinear interpolation, same as Table3D::interp().
+  ------------------------------------------------------------------*/
+  public: double interp(double x, double y, int c = 0)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    return (1.0 - tx)*((1.0 - ty)*a_z[index(i, j) + c]
+        + ty*a_z[index(i, j+1) + c])
+      + tx*((1.0 - ty)*a_z[index(i+1, j) + c]
+        + ty*a_z[index(i+1, j+1) + c]);
+  }
+
+  // Interpolation of all channels at once into "res".
+  public: void interp(double x, double y, double *res)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    const double *p00 = &a_z[index(i, j)];
+    const double *p01 = &a_z[index(i, j+1)];
+    const double *p10 = &a_z[index(i+1, j)];
+    const double *p11 = &a_z[index(i+1, j+1)];
+    double w00 = (1.0 - tx)*(1.0 - ty), w01 = (1.0 - tx)*ty;
+    double w10 = tx*(1.0 - ty), w11 = tx*ty;
+    for (int c = 0; c < nch; ++c)
+      res[c] = w00*p00[c] + w01*p01[c] + w10*p10[c] + w11*p11[c];
+  }
+
+
+  /*------------------------------------------------------------------
+    Position of the first channel of node (i, j) in the tiled array.
+  ------------------------------------------------------------------*/
+  private: size_t index(int i, int j)
+  {
+    size_t tile = size_t(i >> TABLE3D_TILE_LOG)*ntj + (j >> TABLE3D_TILE_LOG);
+    return ((tile << (2*TABLE3D_TILE_LOG))
+      + ((i & (TABLE3D_TILE - 1)) << TABLE3D_TILE_LOG) + (j & (TABLE3D_TILE - 1)))*nch;
+  }
+
+
+}; //=================================================================
+
+
+#endif // TABLE3D_H
+
+
+//====================================================================
@@ -0,0 +1,61 @@
+/*====================================================================
+
+  THE PROGRAM to publish a tabulated function of two arguments in the
+  shared memory, for worker processes to attach it read-only without
+  a copy (see Table3D::publish and Table3D::attach in table3d.h).
+  Publishing again under the same name swaps the table atomically;
+  attached workers switch to it at their Table3D::refresh(). With
+  "-r" the table is removed.
+
+    table3d_publish <name> <table file>
+    table3d_publish -r <name>
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include "table3d.h"
+
+
+/*********************************************************************
+  Basic parameters to setup.
+*********************************************************************/
+
+// Storage order of the published table (see table3d.h).
+const int TABLE_ORDER = TABLE3D_FILE_ORDER;
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  if ( (argc == 3) && (string(argv[1]) == "-r") ) {
+    Table3D::unpublish(argv[2]);
+    return 0;
+  }
+  if (argc != 3) {
+    cout << "Usage: table3d_publish <name> <table file>\n"
+      << "       table3d_publish -r <name>\n";
+    exit(0);
+  }
+
+  Table3D t;
+  t.init(argv[2], TABLE_ORDER);
+  if (!t.publish(argv[1])) {
+    cout << "Can not publish " << argv[2] << " as " << argv[1] << "!\n";
+    exit(0);
+  }
+
+  Table3D check;
+  check.attach(argv[1]);
+  cout << "Table " << argv[2] << " (" << t.getXNum() << " x " << t.getYNum()
+    << " x " << t.getChannelNum() << ") published as " << argv[1]
+    << ", generation " << check.getGeneration() << "\n";
+  return 0;
+}
+
+
+//====================================================================
@@ -0,0 +1,68 @@
+/*====================================================================
+
+  THE PROGRAM to query a table kept by table3d_server: points "x y"
+  are read from the standard input and "x y z" lines are written to
+  the standard output, with all channels of the node for the channel
+  "all". With "-n" the points are node indexes "i j" (getZ).
+
+    table3d_query [-n] <socket> <table> [<channel> | all]
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include "table3d_server.h"
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  int a = 1;
+  bool nodes = (argc > 1) && (string(argv[1]) == "-n");
+  if (nodes) ++a;
+  if (argc - a < 2) {
+    cout << "Usage: table3d_query [-n] <socket> <table> [<channel> | all]\n";
+    exit(0);
+  }
+  string socket_path = argv[a];
+  int table = atoi(argv[a + 1]);
+  uint32_t channel = 0;
+  if (argc - a > 2)
+    channel = (string(argv[a + 2]) == "all") ? TABLE3D_ALL_CHANNELS : atoi(argv[a + 2]);
+
+  Table3DClient client;
+  if (!client.open(socket_path)) {
+    cout << "Can not connect to " << socket_path << "!\n";
+    exit(0);
+  }
+
+  vector<double> xy, z;
+  vector<int32_t> ij;
+  double x, y;
+  while (scanf("%lf %lf", &x, &y) == 2) {
+    xy.push_back(x); xy.push_back(y);
+    ij.push_back(int32_t(x)); ij.push_back(int32_t(y));
+  }
+  bool ok = nodes ? client.getZ(table, channel, ij, z) : client.interp(table, channel, xy, z);
+  if (!ok) {
+    cout << "Query to table " << table << " failed!\n";
+    exit(0);
+  }
+
+  size_t npts = xy.size()/2;
+  size_t nval = (npts > 0) ? z.size()/npts : 0;
+  for (size_t k = 0; k < npts; ++k) {
+    printf("%g %g", xy[2*k], xy[2*k + 1]);
+    for (size_t v = 0; v < nval; ++v)
+      printf(" %g", z[k*nval + v]);
+    printf("\n");
+  }
+  return 0;
+}
+
+
+//====================================================================
@@ -0,0 +1,65 @@
+/*====================================================================
+
+  THE PROGRAM to keep tabulated functions of two arguments loaded and
+  answer queries to them over a Unix domain socket (see
+  table3d_server.h and the client table3d_query.cpp).
+
+    table3d_server <socket> <table file> [<table file> ...]
+
+  Tables are numbered from 0 in the order of the command line.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include "table3d_server.h"
+
+
+/*********************************************************************
+  Basic parameters to setup.
+*********************************************************************/
+
+// Number of connections served at once.
+const int CONN_THREADS = 16;
+
+// Number of threads evaluating large batches, 0 for one per core.
+const int COMPUTE_THREADS = 0;
+
+// Storage order of the tables (see table3d.h).
+const int TABLE_ORDER = TABLE3D_FILE_ORDER;
+
+
+/*********************************************************************
+  Main program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  if (argc < 3) {
+    cout << "Usage: table3d_server <socket> <table file> [<table file> ...]\n";
+    exit(0);
+  }
+
+  vector<Table3D> tables(argc - 2);
+  Table3DServer server;
+  for (int k = 0; k < tables.size(); ++k) {
+    tables[k].init(argv[k + 2], TABLE_ORDER);
+    server.addTable(tables[k]);
+    cout << "Table " << k << " : " << argv[k + 2] << " ("
+      << tables[k].getXNum() << " x " << tables[k].getYNum() << " x "
+      << tables[k].getChannelNum() << ")\n";
+  }
+
+  ThreadPool pool(COMPUTE_THREADS);
+  if (!server.open(argv[1], pool)) {
+    cout << "Can not open socket " << argv[1] << "!\n";
+    exit(0);
+  }
+  cout << "Serving on " << argv[1] << "\n" << flush;
+  server.run(CONN_THREADS);
+  return 0;
+}
+
+
+//====================================================================
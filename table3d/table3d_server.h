@@ -0,0 +1,560 @@
+/*====================================================================
+
+  RESIDENT QUERY SERVER OF TABULATED FUNCTIONS OF TWO ARGUMENTS:
+
+  Table3DServer keeps tables loaded once (see table3d.h) and answers
+  batched queries over a Unix domain socket, so short-lived analysis
+  processes need not parse the tables again. Table3DClient is the
+  client side.
+
+  Protocol (native byte order, the socket is local):
+    request : Table3DRequest, then "count" points: pairs of int32
+              (i, j) for TABLE3D_OP_GETZ, pairs of doubles (x, y)
+              for TABLE3D_OP_INTERP, nothing for TABLE3D_OP_INFO;
+    reply   : Table3DReply, then "count" doubles: values at the
+              points (one channel, or all channels of every point
+              with TABLE3D_ALL_CHANNELS), or for TABLE3D_OP_INFO
+              nx, ny, number of channels, number of tables and
+              ranges of the arguments xmin, xmax, ymin, ymax.
+  Requests of a connection are answered in order with their "id", so
+  a client may send many of them without waiting (pipelining). Large
+  batches are evaluated in chunks over the thread pool; connections
+  are served by a fixed set of threads.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef TABLE3D_SERVER_H
+#define TABLE3D_SERVER_H
+
+#include "table3d.h"
+#include "../thread_pool.h"
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+
+/*--------------------------------------------------------------------
+  Messages of the protocol.
+--------------------------------------------------------------------*/
+struct Table3DRequest
+{
+  char magic[4];        // "T3DQ".
+  uint32_t op;          // TABLE3D_OP_*.
+  uint32_t table;       // Index of the table.
+  uint32_t channel;     // Channel or TABLE3D_ALL_CHANNELS.
+  uint64_t id;          // Returned in the reply.
+  uint64_t count;       // Number of points.
+};
+
+struct Table3DReply
+{
+  char magic[4];        // "T3DR".
+  uint32_t status;      // TABLE3D_OK or TABLE3D_BAD_REQUEST.
+  uint64_t id;          // Id of the request.
+  uint64_t count;       // Number of doubles.
+};
+
+const char TABLE3D_REQUEST_MAGIC[4] = { 'T', '3', 'D', 'Q' };
+const char TABLE3D_REPLY_MAGIC[4] = { 'T', '3', 'D', 'R' };
+
+const uint32_t TABLE3D_OP_INFO = 0;
+const uint32_t TABLE3D_OP_GETZ = 1;
+const uint32_t TABLE3D_OP_INTERP = 2;
+
+const uint32_t TABLE3D_ALL_CHANNELS = 0xFFFFFFFF;
+
+const uint32_t TABLE3D_OK = 0;
+const uint32_t TABLE3D_BAD_REQUEST = 1;
+
+const uint64_t TABLE3D_MAX_POINTS = 1 << 24;    // Points per request.
+const int TABLE3D_SERVER_CHUNK = 4096;          // Points per pool task.
+const int TABLE3D_INFO_NUM = 8;                 // Doubles of info reply.
+
+
+/*--------------------------------------------------------------------
+  Write all "n" bytes to the blocking socket.
+--------------------------------------------------------------------*/
+inline bool table3dWriteAll(int fd, const void *p, size_t n)
+{
+  const char *c = static_cast<const char *>(p);
+  while (n > 0) {
+    ssize_t r = write(fd, c, n);
+    if ( (r < 0) && (errno == EINTR) ) continue;
+    if (r <= 0) return false;
+    c += r; n -= r;
+  }
+  return true;
+}
+
+
+/*--------------------------------------------------------------------
+  Buffered reading of the requests of a connection, so pipelined
+  small requests cost one system call for many.
+--------------------------------------------------------------------*/
+class Table3DSocketReader
+{
+  private: int fd;
+  private: vector<char> buf;
+  private: size_t pos, end;
+
+  public: Table3DSocketReader(int fd_)
+    : fd(fd_), buf(65536), pos(0), end(0) {}
+
+
+  /*------------------------------------------------------------------
+    Read "n" bytes into "p". Returns false at the end or error.
+  ------------------------------------------------------------------*/
+  public: bool read(void *p, size_t n)
+  {
+    char *c = static_cast<char *>(p);
+    while (n > 0) {
+      if (pos == end) {
+        if (n >= buf.size()) {    // Large payload: straight to target.
+          ssize_t r = ::read(fd, c, n);
+          if ( (r < 0) && (errno == EINTR) ) continue;
+          if (r <= 0) return false;
+          c += r; n -= r;
+          continue;
+        }
+        ssize_t r = ::read(fd, &buf[0], buf.size());
+        if ( (r < 0) && (errno == EINTR) ) continue;
+        if (r <= 0) return false;
+        pos = 0; end = r;
+      }
+      size_t m = min(n, end - pos);
+      memcpy(c, &buf[pos], m);
+      pos += m; c += m; n -= m;
+    }
+    return true;
+  }
+};
+
+
+class Table3DServer
+{
+  private: vector<Table3D *> tables;  // Tables served, not owned.
+  private: ThreadPool *pool;          // Pool for large batches.
+  private: int listen_fd;
+  private: string path;               // Socket path.
+
+  // Accepted connections waiting for a thread.
+  private: deque<int> conns;
+  private: mutex mtx;
+  private: condition_variable cv;
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: Table3DServer()
+    { pool = NULL; listen_fd = -1; }
+
+  public: ~Table3DServer()
+    { close(); }
+
+
+  /*------------------------------------------------------------------
+    Add the table, its index is the number of tables added before.
+  ------------------------------------------------------------------*/
+  public: void addTable(Table3D &t)
+    { tables.push_back(&t); }
+
+
+  /*------------------------------------------------------------------
+    Bind the socket, a stale socket file is replaced. Returns false
+    on error.
+  ------------------------------------------------------------------*/
+  public: bool open(const string &socket_path, ThreadPool &thread_pool)
+  {
+    close();
+    pool = &thread_pool;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) return false;
+    unlink(socket_path.c_str());
+    if ( (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+      || (listen(listen_fd, 128) != 0) ) {
+      ::close(listen_fd);
+      listen_fd = -1;
+      return false;
+    }
+    path = socket_path;
+    signal(SIGPIPE, SIG_IGN);   // Clients may go away mid-reply.
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Close the socket and remove its file.
+  ------------------------------------------------------------------*/
+  public: void close()
+  {
+    if (listen_fd < 0) return;
+    ::close(listen_fd);
+    listen_fd = -1;
+    unlink(path.c_str());
+  }
+
+
+  /*------------------------------------------------------------------
+    Accept and serve connections by "nconn" threads until the socket
+    fails.
+  ------------------------------------------------------------------*/
+  public: void run(int nconn)
+  {
+    vector<thread> workers;
+    for (int i = 0; i < max(nconn, 1); ++i)
+      workers.push_back(thread(&Table3DServer::connLoop, this));
+    for (;;) {
+      int fd = accept(listen_fd, NULL, NULL);
+      if ( (fd < 0) && (errno == EINTR) ) continue;
+      if (fd < 0) break;
+      lock_guard<mutex> lock(mtx);
+      conns.push_back(fd);
+      cv.notify_one();
+    }
+    {
+      lock_guard<mutex> lock(mtx);
+      conns.push_back(-1);      // Stop mark for every thread.
+      cv.notify_all();
+    }
+    for (int i = 0; i < workers.size(); ++i)
+      workers[i].join();
+  }
+
+
+  /*------------------------------------------------------------------
+    Connection thread: serve queued connections one by one.
+  ------------------------------------------------------------------*/
+  private: void connLoop()
+  {
+    for (;;) {
+      int fd;
+      {
+        unique_lock<mutex> lock(mtx);
+        while (conns.empty()) cv.wait(lock);
+        fd = conns.front();
+        if (fd < 0) return;     // Stop mark is left for others.
+        conns.pop_front();
+      }
+      serve(fd);
+      ::close(fd);
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Answer the requests of the connection until it is closed.
+  ------------------------------------------------------------------*/
+  private: void serve(int fd)
+  {
+    Table3DSocketReader in(fd);
+    vector<char> payload;
+    vector<double> out;
+    Table3DRequest rq;
+    while (in.read(&rq, sizeof(rq))) {
+      if ( (memcmp(rq.magic, TABLE3D_REQUEST_MAGIC, 4) != 0)
+        || (rq.count > TABLE3D_MAX_POINTS) ) return;
+      size_t point_size = (rq.op == TABLE3D_OP_GETZ) ? 2*sizeof(int32_t)
+        : (rq.op == TABLE3D_OP_INTERP) ? 2*sizeof(double) : 0;
+      payload.resize(rq.count*point_size);
+      if ( !payload.empty() && !in.read(&payload[0], payload.size()) ) return;
+
+      Table3DReply rp;
+      memcpy(rp.magic, TABLE3D_REPLY_MAGIC, 4);
+      rp.id = rq.id;
+      rp.status = compute(rq, payload, out) ? TABLE3D_OK : TABLE3D_BAD_REQUEST;
+      if (rp.status != TABLE3D_OK) out.clear();
+      rp.count = out.size();
+
+      struct iovec iov[2];
+      iov[0].iov_base = &rp; iov[0].iov_len = sizeof(rp);
+      iov[1].iov_base = out.empty() ? NULL : &out[0];
+      iov[1].iov_len = out.size()*sizeof(double);
+      ssize_t r;
+      do r = writev(fd, iov, 2); while ( (r < 0) && (errno == EINTR) );
+      if (r < 0) return;
+      size_t sent = r;
+      if (sent < sizeof(rp)) {
+        if (!table3dWriteAll(fd, (char *) &rp + sent, sizeof(rp) - sent)) return;
+        sent = sizeof(rp);
+      }
+      if (!table3dWriteAll(fd, (char *) iov[1].iov_base + (sent - sizeof(rp)),
+        iov[1].iov_len - (sent - sizeof(rp)))) return;
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Evaluate the request into "out". Returns false for a bad one.
+  ------------------------------------------------------------------*/
+  private: bool compute(const Table3DRequest &rq, const vector<char> &payload,
+    vector<double> &out)
+  {
+    if (rq.table >= tables.size()) return false;
+    Table3D &t = *tables[rq.table];
+    int nx = t.getXNum(), ny = t.getYNum(), nch = t.getChannelNum();
+
+    if (rq.op == TABLE3D_OP_INFO) {
+      out.resize(TABLE3D_INFO_NUM);
+      out[0] = nx; out[1] = ny; out[2] = nch; out[3] = tables.size();
+      out[4] = t.getX(0); out[5] = t.getX(nx - 1);
+      out[6] = t.getY(0); out[7] = t.getY(ny - 1);
+      return true;
+    }
+    if ( (rq.op != TABLE3D_OP_GETZ) && (rq.op != TABLE3D_OP_INTERP) ) return false;
+    bool all = (rq.channel == TABLE3D_ALL_CHANNELS);
+    if ( !all && (rq.channel >= nch) ) return false;
+    int nval = all ? nch : 1;
+    int n = rq.count;
+    out.resize(size_t(n)*nval);
+
+    // Indexes are checked before the evaluation.
+    const int32_t *ij = (const int32_t *) payload.data();
+    if (rq.op == TABLE3D_OP_GETZ)
+      for (int k = 0; k < n; ++k)
+        if ( (ij[2*k] < 0) || (ij[2*k] >= nx) || (ij[2*k+1] < 0) || (ij[2*k+1] >= ny) )
+          return false;
+
+    int nchunk = (n + TABLE3D_SERVER_CHUNK - 1)/TABLE3D_SERVER_CHUNK;
+    pool->parallelFor(nchunk, [&](int ic) {
+      int k_end = min(n, (ic + 1)*TABLE3D_SERVER_CHUNK);
+      double *o = &out[0];
+      if (rq.op == TABLE3D_OP_GETZ) {
+        for (int k = ic*TABLE3D_SERVER_CHUNK; k < k_end; ++k)
+          if (all)
+            memcpy(o + size_t(k)*nch, t.getZAll(ij[2*k], ij[2*k+1]), nch*sizeof(double));
+          else
+            o[k] = t.getZ(ij[2*k], ij[2*k+1], rq.channel);
+      } else {
+        const double *xy = (const double *) payload.data();
+        for (int k = ic*TABLE3D_SERVER_CHUNK; k < k_end; ++k)
+          if (all)
+            t.interp(xy[2*k], xy[2*k+1], o + size_t(k)*nch);
+          else
+            o[k] = t.interp(xy[2*k], xy[2*k+1], rq.channel);
+      }
+    });
+    return true;
+  }
+
+
+}; //=================================================================
+
+
+class Table3DClient
+{
+  private: int fd;
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: Table3DClient()
+    { fd = -1; }
+
+  public: ~Table3DClient()
+    { close(); }
+
+
+  /*------------------------------------------------------------------
+    Connect to the server. Returns false on error.
+  ------------------------------------------------------------------*/
+  public: bool open(const string &socket_path)
+  {
+    close();
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socket_path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+      close();
+      return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Close the connection.
+  ------------------------------------------------------------------*/
+  public: void close()
+  {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+  }
+
+
+  /*------------------------------------------------------------------
+    Sizes and argument ranges of the table (see TABLE3D_OP_INFO).
+  ------------------------------------------------------------------*/
+  public: bool info(int table, double res[TABLE3D_INFO_NUM])
+  {
+    vector<double> out;
+    if ( !exchange(TABLE3D_OP_INFO, table, 0, NULL, 0, 1, 1, out, 1)
+      || (out.size() != TABLE3D_INFO_NUM) ) return false;
+    copy(out.begin(), out.end(), res);
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Values at the nodes (i[k], j[k]) into "z": one value per point,
+    or all channels of every point with TABLE3D_ALL_CHANNELS.
+  ------------------------------------------------------------------*/
+  public: bool getZ(int table, uint32_t channel, const vector<int32_t> &ij,
+    vector<double> &z, size_t batch = 65536, int window = 8)
+  {
+    return exchange(TABLE3D_OP_GETZ, table, channel, ij.empty() ? NULL : (const char *) &ij[0],
+      2*sizeof(int32_t), ij.size()/2, batch, z, window);
+  }
+
+
+  /*------------------------------------------------------------------
+    Interpolation at the points (xy[2k], xy[2k+1]) into "z", as
+    getZ().
+  ------------------------------------------------------------------*/
+  public: bool interp(int table, uint32_t channel, const vector<double> &xy,
+    vector<double> &z, size_t batch = 65536, int window = 8)
+  {
+    return exchange(TABLE3D_OP_INTERP, table, channel, xy.empty() ? NULL : (const char *) &xy[0],
+      2*sizeof(double), xy.size()/2, batch, z, window);
+  }
+
+
+  /*------------------------------------------------------------------
+    Send the points in batches of "batch", keeping up to "window"
+    requests in flight, and collect the replies in order. Sending and
+    receiving are interleaved by poll(), so neither side blocks the
+    other however large the batches are. On failure the connection is
+    closed, as replies may be left in flight.
+  ------------------------------------------------------------------*/
+  private: bool exchange(uint32_t op, int table, uint32_t channel,
+    const char *points, size_t point_size, size_t npts, size_t batch,
+    vector<double> &z, int window)
+  {
+    if (exchangeBatches(op, table, channel, points, point_size, npts, batch, z, window))
+      return true;
+    close();
+    z.clear();
+    return false;
+  }
+
+  private: bool exchangeBatches(uint32_t op, int table, uint32_t channel,
+    const char *points, size_t point_size, size_t npts, size_t batch,
+    vector<double> &z, int window)
+  {
+    z.clear();
+    if (fd < 0) return false;
+    batch = max(min(batch, size_t(TABLE3D_MAX_POINTS)), size_t(1));
+    size_t nreq = (op == TABLE3D_OP_INFO) ? 1 : (npts + batch - 1)/batch;
+    if (nreq == 0) return true;
+
+    size_t nval = 0;                    // Values per point, from 1st reply.
+    size_t sent_req = 0, sent_bytes = 0;// Request being sent and its progress.
+    size_t recv_req = 0, recv_bytes = 0;// Reply being received and its progress.
+    Table3DRequest rq;
+    Table3DReply rp;
+    memcpy(rq.magic, TABLE3D_REQUEST_MAGIC, 4);
+    rq.op = op; rq.table = table; rq.channel = channel;
+
+    while (recv_req < nreq) {
+      size_t first = sent_req*batch;
+      size_t count = (op == TABLE3D_OP_INFO) ? 0 : min(batch, npts - min(first, npts));
+      bool can_send = (sent_req < nreq) && (sent_req < recv_req + window);
+      struct pollfd pfd;
+      pfd.fd = fd;
+      pfd.events = POLLIN | (can_send ? POLLOUT : 0);
+      if (poll(&pfd, 1, -1) < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      if (pfd.revents & (POLLERR | POLLNVAL)) return false;
+
+      // Send more of the current request.
+      if (can_send && (pfd.revents & POLLOUT)) {
+        rq.id = sent_req; rq.count = count;
+        struct iovec iov[2];
+        size_t hdr_left = (sent_bytes < sizeof(rq)) ? sizeof(rq) - sent_bytes : 0;
+        size_t body_done = sent_bytes - (sizeof(rq) - hdr_left);
+        iov[0].iov_base = (char *) &rq + (sizeof(rq) - hdr_left);
+        iov[0].iov_len = hdr_left;
+        iov[1].iov_base = (void *) (points + first*point_size + body_done);
+        iov[1].iov_len = count*point_size - body_done;
+        ssize_t r = writev(fd, iov, 2);
+        if ( (r < 0) && (errno != EAGAIN) && (errno != EINTR) ) return false;
+        if (r > 0) sent_bytes += r;
+        if (sent_bytes == sizeof(rq) + count*point_size) {
+          ++sent_req;
+          sent_bytes = 0;
+        }
+      }
+
+      // Receive more of the current reply.
+      if (pfd.revents & (POLLIN | POLLHUP)) {
+        size_t rfirst = recv_req*batch;
+        size_t rcount = (op == TABLE3D_OP_INFO) ? 1 : min(batch, npts - rfirst);
+        ssize_t r;
+        if (recv_bytes < sizeof(rp)) {
+          r = read(fd, (char *) &rp + recv_bytes, sizeof(rp) - recv_bytes);
+        } else {
+          size_t done = recv_bytes - sizeof(rp);
+          r = read(fd, (char *) &z[rfirst*nval] + done, rp.count*sizeof(double) - done);
+        }
+        if (r == 0) return false;
+        if ( (r < 0) && (errno != EAGAIN) && (errno != EINTR) ) return false;
+        if (r > 0) recv_bytes += r;
+        if (recv_bytes == sizeof(rp)) {
+          if ( (memcmp(rp.magic, TABLE3D_REPLY_MAGIC, 4) != 0) || (rp.id != recv_req)
+            || (rp.status != TABLE3D_OK) ) return false;
+          if (op == TABLE3D_OP_INFO) {
+            nval = rp.count;
+            z.resize(nval);
+          } else if (nval == 0) {
+            nval = rp.count/rcount;
+            z.resize(npts*nval);
+          }
+          if ( (nval == 0) || (rp.count != rcount*nval) ) return false;
+        }
+        if (recv_bytes == sizeof(rp) + rp.count*sizeof(double)) {
+          ++recv_req;
+          recv_bytes = 0;
+        }
+      }
+    }
+    return true;
+  }
+
+
+}; //=================================================================
+
+
+#endif // TABLE3D_SERVER_H
+
+
+//====================================================================
@@ -0,0 +1,343 @@
+/*====================================================================
+
+  DEFINITION OF THE OUT-OF-CORE TABULATED FUNCTION OF TWO ARGUMENTS:
+
+  The grid is kept on disk in fixed-size square tiles and paged in on
+  demand by an LRU tile cache with a given memory budget, so tables
+  larger than the memory can be used. See table3d.h for the in-memory
+  object.
+
+  Tile file layout (native byte order):
+    header      : "T3DTILE1", nx, ny, tile side, number of channels,
+                  offset of tiles;
+    arguments   : nx values of 1st argument, ny values of 2nd one;
+    tiles       : tile side^2 nodes each, 2nd argument fast inside
+                  a tile, channels of a node next to each other,
+                  tiles follow each other along 2nd argument, tiles
+                  at the edges are padded with zeros.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef TABLE3D_STREAM_H
+#define TABLE3D_STREAM_H
+
+#include "table3d.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <list>
+
+
+/*--------------------------------------------------------------------
+  Header of the tile file.
+--------------------------------------------------------------------*/
+struct Table3DTileHeader
+{
+  char magic[8];        // "T3DTILE1".
+  int32_t nx;           // Number of 1st arguments.
+  int32_t ny;           // Number of 2nd arguments.
+  int32_t tile;         // Tile side.
+  int32_t nch;          // Number of values (channels) per node.
+  int64_t data_offset;  // Offset of the first tile.
+};
+
+const char TABLE3D_TILE_MAGIC[8] = { 'T', '3', 'D', 'T', 'I', 'L', 'E', '1' };
+const int64_t TABLE3D_TILE_ALIGN = 4096;
+
+
+/*--------------------------------------------------------------------
+  Convert text table "x y z1 ... zk" to the tile file. The text is
+  read twice: first for the grid, then for values, keeping in memory
+  only one band of "tile" lines along the slow argument.
+--------------------------------------------------------------------*/
+inline void table3dTextToTiles(
+  const string &text_name,  // Name of text file with the table.
+  const string &tile_name,  // Name of the tile file to create.
+  int tile)                 // Tile side.
+{
+  Table3D grid;
+  grid.initGrid(text_name);
+  int nx, ny;
+  grid.getZnum(nx, ny);
+  bool x_slow = (grid.getOrder() == TABLE3D_X_SLOW);
+  int nslow = x_slow ? nx : ny;
+  int nfast = x_slow ? ny : nx;
+  int ntj = (ny + tile - 1)/tile;
+  int nch = grid.getChannelNum();
+
+  Table3DTileHeader hdr;
+  memcpy(hdr.magic, TABLE3D_TILE_MAGIC, 8);
+  hdr.nx = nx; hdr.ny = ny; hdr.tile = tile; hdr.nch = nch;
+  int64_t arg_end = sizeof(hdr) + (int64_t(nx) + ny)*sizeof(double);
+  hdr.data_offset = (arg_end + TABLE3D_TILE_ALIGN - 1)
+    /TABLE3D_TILE_ALIGN*TABLE3D_TILE_ALIGN;
+
+  int fd = open(tile_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cout << "Can not create file " << tile_name << "!\n";
+    exit(0);
+  }
+  vector<double> args;
+  for (int i = 0; i < nx; ++i) args.push_back(grid.getX(i));
+  for (int j = 0; j < ny; ++j) args.push_back(grid.getY(j));
+  bool ok = (pwrite(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr));
+  ok = ok && (pwrite(fd, &args[0], args.size()*sizeof(double), sizeof(hdr))
+    == ssize_t(args.size()*sizeof(double)));
+
+  // Read values band by band and scatter each band over its tiles.
+  size_t tile_bytes = size_t(tile)*tile*nch*sizeof(double);
+  vector<double> band(size_t(tile)*nfast*nch, 0.0);
+  vector<double> buf(size_t(tile)*tile*nch);
+  DataInputStream fin(text_name);
+  string s;
+  int64_t k = 0;
+  while (ok && getline(fin, s))
+    if (s.find_first_not_of(" \t\r") != string::npos) {
+      istringstream ss(s);
+      double tmp;
+      ss >> tmp >> tmp;
+      int is = k/nfast;
+      int jf = k%nfast;
+      for (int c = 0; c < nch; ++c)
+        ss >> band[(size_t(is%tile)*nfast + jf)*nch + c];
+      ++k;
+      if ( (jf < nfast - 1) || ((is%tile < tile - 1) && (is < nslow - 1)) )
+        continue;
+
+      int b = is/tile;
+      for (int fb = 0; fb*tile < nfast; ++fb) {
+        fill(buf.begin(), buf.end(), 0.0);
+        for (int rs = 0; rs <= is%tile; ++rs)
+          for (int fs = 0; (fs < tile) && (fb*tile + fs < nfast); ++fs) {
+            const double *v = &band[(size_t(rs)*nfast + fb*tile + fs)*nch];
+            double *dst = x_slow ? &buf[(rs*tile + fs)*nch]
+              : &buf[(fs*tile + rs)*nch];
+            for (int c = 0; c < nch; ++c) dst[c] = v[c];
+          }
+        int64_t id = x_slow ? int64_t(b)*ntj + fb : int64_t(fb)*ntj + b;
+        ok = ok && (pwrite(fd, &buf[0], tile_bytes,
+          hdr.data_offset + id*tile_bytes) == ssize_t(tile_bytes));
+      }
+    }
+  if (!fin.error().empty()) {
+    cout << fin.error() << "\n";
+    exit(0);
+  }
+  fin.close();
+  if (!ok || (k != int64_t(nx)*ny)) {
+    cout << "Failed to write tiles of " << text_name << " to "
+      << tile_name << "!\n";
+    exit(0);
+  }
+  close(fd);
+}
+
+
+class Table3DStream
+{
+  private: int fd;                  // Tile file descriptor.
+  private: vector<double> a_x;      // Array of 1st argument.
+  private: vector<double> a_y;      // Array of 2nd argument.
+  private: UniformAxis u_x;         // Uniform axis of 1st argument, if any.
+  private: UniformAxis u_y;         // Uniform axis of 2nd argument, if any.
+  private: int tile;                // Tile side.
+  private: int nch;                 // Number of values (channels) per node.
+  private: int ntj;                 // Number of tiles along 2nd argument.
+  private: int64_t data_offset;     // Offset of the first tile.
+  private: size_t tile_size;        // Number of values in a tile.
+
+  private: vector<double> pool;     // Cached tiles.
+  private: vector<int> slot_tile;   // Tile kept in the slot, -1 if none.
+  private: list<int> lru;           // Slots, most recently used first.
+  private: vector<list<int>::iterator> slot_pos;  // Position of the slot in "lru".
+  private: vector<int> tile_slot;   // Slot of the tile, -1 if not cached.
+  private: int64_t miss_count;      // Number of tiles read from disk.
+
+  private: int last_tile;           // Tile of the last access.
+  private: const double *last_ptr;  // Values of the last tile.
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor. The object owns the file descriptor and
+    is not copied.
+  ------------------------------------------------------------------*/
+  public: Table3DStream()
+    { fd = -1; clear(); }
+
+  public: ~Table3DStream()
+    { clear(); }
+
+  public: Table3DStream(const Table3DStream &) = delete;
+  public: Table3DStream &operator=(const Table3DStream &) = delete;
+
+
+  /*------------------------------------------------------------------
+    Clear object.
+  ------------------------------------------------------------------*/
+  public: void clear()
+  {
+    if (fd >= 0) close(fd);
+    fd = -1;
+    a_x.clear(); a_y.clear();
+    u_x.clear(); u_y.clear();
+    pool.clear(); slot_tile.clear(); tile_slot.clear();
+    lru.clear(); slot_pos.clear();
+    tile = 0; nch = 0; ntj = 0; data_offset = 0; tile_size = 0;
+    miss_count = 0;
+    last_tile = -1; last_ptr = NULL;
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization by opening the tile file. The cache takes at most
+    "budget" bytes, but not less than four tiles needed for the
+    interpolation.
+  ------------------------------------------------------------------*/
+  public: void init(
+    string tile_name,   // Name of the tile file.
+    size_t budget)      // Memory budget of the tile cache [bytes].
+  {
+    clear();
+    fd = open(tile_name.c_str(), O_RDONLY);
+    Table3DTileHeader hdr;
+    if ( (fd < 0) || (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+      || (memcmp(hdr.magic, TABLE3D_TILE_MAGIC, 8) != 0)
+      || (hdr.nx < 2) || (hdr.ny < 2) || (hdr.tile < 1) || (hdr.nch < 1) ) {
+      cout << "File " << tile_name << " is not a tile file!\n";
+      exit(0);
+    }
+
+    a_x.resize(hdr.nx); a_y.resize(hdr.ny);
+    ssize_t bx = hdr.nx*sizeof(double), by = hdr.ny*sizeof(double);
+    if ( (pread(fd, &a_x[0], bx, sizeof(hdr)) != bx)
+      || (pread(fd, &a_y[0], by, sizeof(hdr) + bx) != by) ) {
+      cout << "Arguments in file " << tile_name << " are truncated!\n";
+      exit(0);
+    }
+    u_x.init(a_x);
+    u_y.init(a_y);
+    tile = hdr.tile;
+    nch = hdr.nch;
+    ntj = (hdr.ny + tile - 1)/tile;
+    data_offset = hdr.data_offset;
+    tile_size = size_t(tile)*tile*nch;
+
+    int ntile = ((hdr.nx + tile - 1)/tile)*ntj;
+    int nslot = budget/(tile_size*sizeof(double));
+    nslot = max(4, min(nslot, ntile));
+    pool.resize(nslot*tile_size);
+    slot_tile.assign(nslot, -1);
+    slot_pos.resize(nslot);
+    for (int s = 0; s < nslot; ++s)
+      slot_pos[s] = lru.insert(lru.end(), s);
+    tile_slot.assign(ntile, -1);
+  }
+
+
+  /*------------------------------------------------------------------
+    Array sizes.
+  ------------------------------------------------------------------*/
+  public: int getXNum() { return a_x.size(); }
+  public: int getYNum() { return a_y.size(); }
+  public: int getChannelNum() { return nch; }
+
+  public: int64_t getMissNum() { return miss_count; }
+
+
+  /*------------------------------------------------------------------
+    Get array values.
+  ------------------------------------------------------------------*/
+  public: double getX(int i) { return a_x[i]; }
+  public: double getY(int j) { return a_y[j]; }
+
+  public: double getZ(int i, int j, int c = 0)
+    { return getZAll(i, j)[c]; }
+
+  // Values of all channels of the node, valid until the next access.
+  public: const double *getZAll(int i, int j)
+  {
+    int t = (i/tile)*ntj + j/tile;
+    if (t != last_tile) {
+      last_ptr = fetch(t, last_tile);
+      last_tile = t;
+    }
+    return last_ptr + ((i%tile)*tile + j%tile)*nch;
+  }
+
+
+  /*------------------------------------------------------------------
+    Bilinear interpolation, same as Table3D::interp().
+  ------------------------------------------------------------------*/
+  public: double interp(double x, double y, int c = 0)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    return (1.0 - tx)*((1.0 - ty)*getZ(i, j, c) + ty*getZ(i, j+1, c))
+      + tx*((1.0 - ty)*getZ(i+1, j, c) + ty*getZ(i+1, j+1, c));
+  }
+
+  // Interpolation of all channels at once into "res".
+  public: void interp(double x, double y, double *res)
+  {
+    int i = table3dLocate(a_x, u_x, x);
+    int j = table3dLocate(a_y, u_y, y);
+    double tx = (x - a_x[i])/(a_x[i+1] - a_x[i]);
+    double ty = (y - a_y[j])/(a_y[j+1] - a_y[j]);
+    double w[4] = { (1.0 - tx)*(1.0 - ty), (1.0 - tx)*ty,
+      tx*(1.0 - ty), tx*ty };
+    for (int c = 0; c < nch; ++c) res[c] = 0.0;
+    for (int n = 0; n < 4; ++n) {
+      const double *p = getZAll(i + n/2, j + n%2);
+      for (int c = 0; c < nch; ++c) res[c] += w[n]*p[c];
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Get values of tile "t", reading it in place of the least recently
+    used one on a miss. When moving to the neighbouring tile along a
+    row or a column, the next tile in that direction is prefetched.
+  ------------------------------------------------------------------*/
+  private: const double *fetch(int t, int prev)
+  {
+    int d = t - prev;
+    if ( (prev >= 0) && ((d == 1) || (d == ntj)) ) {
+      int next = t + d;
+      if ( (next < tile_slot.size()) && (tile_slot[next] < 0) )
+        posix_fadvise(fd, data_offset + int64_t(next)*tile_size*sizeof(double),
+          tile_size*sizeof(double), POSIX_FADV_WILLNEED);
+    }
+
+    int s = tile_slot[t];
+    if (s < 0) {
+      s = lru.back();
+      if (slot_tile[s] >= 0) tile_slot[slot_tile[s]] = -1;
+      size_t bytes = tile_size*sizeof(double);
+      if (pread(fd, &pool[s*tile_size], bytes,
+        data_offset + int64_t(t)*bytes) != ssize_t(bytes)) {
+        cout << "Failed to read tile " << t << "!\n";
+        exit(0);
+      }
+      slot_tile[s] = t;
+      tile_slot[t] = s;
+      ++miss_count;
+    }
+    lru.splice(lru.begin(), lru, slot_pos[s]);
+    return &pool[s*tile_size];
+  }
+
+
+}; //=================================================================
+
+
+#endif // TABLE3D_STREAM_H
+
+
+//====================================================================
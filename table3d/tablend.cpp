@@ -0,0 +1,59 @@
+/*====================================================================
+
+  TEST PROGRAM for the tabulated function of N arguments object
+  (see tablend.h).
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#include "tablend.h"
+
+
+/*********************************************************************
+  Test program.
+*********************************************************************/
+int main(int argc, char **argv)
+{
+  // --- Three arguments, 2nd is fast, 3rd is slow. ------------------
+  TableND<3> t;
+  t.init("data3d.dat");
+
+  cout << "\nSizes:";
+  for(int k = 0; k < 3; ++k) cout << " " << t.getNum(k);
+  cout << "\nArguments from fast to slow:";
+  for(int m = 0; m < 3; ++m) cout << " " << t.getFast(m);
+  cout << "\n";
+
+  for(int k = 0; k < 3; ++k) {
+    cout << "  arg " << k << ":";
+    for(int i = 0; i < t.getNum(k); ++i) cout << " " << t.getArg(k, i);
+    cout << "\n";
+  }
+
+  cout << "\nTable:\n";
+  int idx[3];
+  for(idx[0] = 0; idx[0] < t.getNum(0); ++idx[0])
+    for(idx[1] = 0; idx[1] < t.getNum(1); ++idx[1])
+      for(idx[2] = 0; idx[2] < t.getNum(2); ++idx[2])
+        cout << "  f(" << idx[0] << ", " << idx[1] << ", " << idx[2]
+          << ") = " << t.getF(idx) << "\n";
+
+  double x[3] = { 1.5, 2.5, 15.0 };
+  cout << "\nInterpolation at (1.5, 2.5, 15): " << t.interp(x)
+    << " (exact 190)\n";
+
+  // --- Single precision. -------------------------------------------
+  TableND<3, float> tf;
+  tf.init("data3d.dat");
+  float xf[3] = { 1.25f, 1.0f, 20.0f };
+  cout << "Interpolation at (1.25, 1, 20), float: " << tf.interp(xf)
+    << " (exact 155)\n";
+
+  return 0;
+}
+
+
+//====================================================================
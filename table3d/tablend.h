@@ -0,0 +1,233 @@
+/*====================================================================
+
+  DEFINITION OF THE TABULATED FUNCTION OF N ARGUMENTS OBJECT:
+
+  Generalization of Table3D (see table3d.h) to any number of
+  arguments N fixed at compile time. The object loads the lines
+  "x1 ... xN f" in any order of arguments, keeps the function values
+  in one flat array with strides per argument and interpolates them
+  multilinearly.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef TABLEND_H
+#define TABLEND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include "../zstream.h"
+using namespace std;
+
+
+/*--------------------------------------------------------------------
+  Multilinear interpolation over the cell with the corner "p": linear
+  interpolation along argument K of two interpolations over the
+  remaining arguments. Unrolled by the compiler into 2^N corners.
+--------------------------------------------------------------------*/
+template <int N, class T, int K> struct TableNDInterp
+{
+  static T eval(const T *p, const size_t *stride, const T *t)
+  {
+    return (T(1) - t[K])*TableNDInterp<N, T, K + 1>::eval(p, stride, t)
+      + t[K]*TableNDInterp<N, T, K + 1>::eval(p + stride[K], stride, t);
+  }
+};
+
+template <int N, class T> struct TableNDInterp<N, T, N>
+{
+  static T eval(const T *p, const size_t *, const T *)
+    { return *p; }
+};
+
+
+template <int N, class T = double> class TableND
+{
+  static_assert(N >= 1, "TableND needs at least one argument");
+
+  private: vector<T> a_arg[N];  // Arrays of arguments.
+  private: vector<T> a_f;       // Flat array of function values.
+  private: size_t stride[N];    // Strides of "a_f" along arguments.
+  private: int order[N];        // Arguments from the fastest to the slowest.
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: TableND()
+    { clear(); }
+
+  public: ~TableND()
+    { clear(); }
+
+
+  /*------------------------------------------------------------------
+    Clear object.
+  ------------------------------------------------------------------*/
+  public: void clear()
+  {
+    for (int k = 0; k < N; ++k) {
+      a_arg[k].clear();
+      stride[k] = 0;
+      order[k] = k;
+    }
+    a_f.clear();
+  }
+
+
+  /*------------------------------------------------------------------
+    Initialization by loading the data from file. The arguments may
+    go in any order, each one changing with a constant period. The
+    period of argument k (its stride) is the number of the line where
+    it changes first; sorted strides must be products of the numbers
+    of faster arguments. Lines are kept while the order is unknown.
+  ------------------------------------------------------------------*/
+  public: void init(
+    string file_name)   // Name of file to load data.
+  {
+    clear();
+
+    struct stat st;
+    if (stat(file_name.c_str(), &st) != 0) {
+      cout << "File " << file_name << " not found!\n";
+      exit(0);
+    }
+
+    // Read lines "x1 ... xN f".
+    vector<T> rows;
+    DataInputStream fin(file_name);
+    string s;
+    while (getline(fin, s))
+      if (s.find_first_not_of(" \t\r") != string::npos) {
+        istringstream ss(s);
+        T tmp;
+        for (int k = 0; k <= N; ++k) {
+          if (!(ss >> tmp)) {
+            cout << "Short line in file " << file_name << "!\n";
+            exit(0);
+          }
+          rows.push_back(tmp);
+        }
+      }
+    if (!fin.error().empty()) {
+      cout << fin.error() << "\n";
+      exit(0);
+    }
+    fin.close();
+    size_t nline = rows.size()/(N + 1);
+    if (nline == 0) {
+      cout << "No data in file " << file_name << "!\n";
+      exit(0);
+    }
+
+    // Strides: lines of the first change, 0 for constant arguments.
+    for (int k = 0; k < N; ++k) {
+      stride[k] = 0;
+      for (size_t l = 1; l < nline; ++l)
+        if (rows[l*(N + 1) + k] != rows[k]) { stride[k] = l; break; }
+    }
+
+    // Order of arguments and their sizes.
+    for (int k = 0; k < N; ++k) order[k] = k;
+    for (int a = 1; a < N; ++a)   // Insertion sort, constant ones last.
+      for (int b = a; b > 0; --b) {
+        size_t s1 = stride[order[b-1]], s2 = stride[order[b]];
+        if ( (s1 == 0) || ((s2 != 0) && (s2 < s1)) )
+          swap(order[b-1], order[b]);
+      }
+
+    size_t period = 1;
+    for (int m = 0; m < N; ++m) {
+      int k = order[m];
+      if (stride[k] == 0) stride[k] = period;
+      if ( (stride[k] != period) || (nline%period != 0) ) {
+        cout << "No order in file " << file_name << "!\n";
+        exit(0);
+      }
+      size_t n = (m == N - 1) ? nline/period : 0;
+      if (m < N - 1) {
+        size_t next = stride[order[m+1]];
+        n = (next == 0) ? nline/period : next/period;
+      }
+      for (size_t i = 0; i < n; ++i)
+        a_arg[k].push_back(rows[i*period*(N + 1) + k]);
+      period *= n;
+    }
+    if (period != nline) {
+      cout << "Not rectangular grid in file " << file_name << "!\n";
+      exit(0);
+    }
+
+    // Check every line against the grid and keep the values.
+    a_f.resize(nline);
+    for (size_t l = 0; l < nline; ++l) {
+      for (int k = 0; k < N; ++k)
+        if (rows[l*(N + 1) + k] != a_arg[k][(l/stride[k])%a_arg[k].size()]) {
+          cout << "Irregular grid in file " << file_name
+            << " at line " << l << "!\n";
+          exit(0);
+        }
+      a_f[l] = rows[l*(N + 1) + N];
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Array sizes and order of arguments.
+  ------------------------------------------------------------------*/
+  public: int getNum(int k) { return a_arg[k].size(); }
+  public: int getFast(int m) { return order[m]; }
+
+
+  /*------------------------------------------------------------------
+    Get array values.
+  ------------------------------------------------------------------*/
+  public: T getArg(int k, int i) { return a_arg[k][i]; }
+
+  public: T getF(const int *idx)
+  {
+    size_t p = 0;
+    for (int k = 0; k < N; ++k) p += idx[k]*stride[k];
+    return a_f[p];
+  }
+
+
+  /*------------------------------------------------------------------
+    Multilinear interpolation. Arguments outside the grid are
+    extrapolated from the boundary cell; arguments with a single
+    grid value are ignored.
+  ------------------------------------------------------------------*/
+  public: T interp(const T *x)
+  {
+    T t[N];
+    size_t p = 0;
+    size_t cell_stride[N];
+    for (int k = 0; k < N; ++k) {
+      const vector<T> &a = a_arg[k];
+      if (a.size() < 2) { t[k] = T(0); cell_stride[k] = 0; continue; }
+      int i = upper_bound(a.begin() + 1, a.end() - 1, x[k]) - a.begin() - 1;
+      t[k] = (x[k] - a[i])/(a[i+1] - a[i]);
+      p += i*stride[k];
+      cell_stride[k] = stride[k];
+    }
+    return TableNDInterp<N, T, 0>::eval(&a_f[p], cell_stride, t);
+  }
+
+
+}; //=================================================================
+
+
+#endif // TABLEND_H
+
+
+//====================================================================
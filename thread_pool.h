@@ -0,0 +1,177 @@
+/*====================================================================
+
+  DEFINITION OF THE THREAD POOL OBJECT:
+
+  Fixed set of worker threads running parallel loops. The calling
+  thread takes part in its own loop, so loops may be nested (files
+  over the pool, points of each file over the same pool) without
+  deadlock or oversubscription. Loop records and the queue are
+  reused and the loop body is called through a plain function
+  pointer, so parallel loops do not allocate memory once the pool is
+  warmed up.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+class ThreadPool
+{
+  /*------------------------------------------------------------------
+    Parallel loop shared by the threads taking part in it.
+  ------------------------------------------------------------------*/
+  private: struct Loop
+  {
+    void (*call)(const void *, int);  // Calls the body with an iteration.
+    const void *body;                 // Loop body.
+    int n;                            // Number of iterations.
+    std::atomic<int> next;            // Next iteration to take.
+    std::atomic<int> done;            // Number of finished iterations.
+    int running;                      // Workers in the loop (under mtx).
+  };
+
+  private: std::vector<std::thread> workers;
+  private: std::vector<Loop *> queue;   // Loops to join, one entry per helper.
+  private: std::vector<Loop *> spare;   // Finished loop records for reuse.
+  private: std::mutex mtx;
+  private: std::condition_variable cv;
+  private: std::condition_variable cv_done;
+  private: bool stop;
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor. Zero number of threads means one per
+    hardware thread; the calling thread counts as one of them.
+  ------------------------------------------------------------------*/
+  public: ThreadPool(int nthread = 0)
+  {
+    stop = false;
+    if (nthread <= 0) nthread = std::thread::hardware_concurrency();
+    for (int i = 1; i < nthread; ++i)
+      workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+  }
+
+  public: ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stop = true;
+    }
+    cv.notify_all();
+    for (int i = 0; i < workers.size(); ++i)
+      workers[i].join();
+    for (int i = 0; i < spare.size(); ++i)
+      delete spare[i];
+  }
+
+
+  /*------------------------------------------------------------------
+    Number of threads including the calling one.
+  ------------------------------------------------------------------*/
+  public: int size() { return workers.size() + 1; }
+
+
+  /*------------------------------------------------------------------
+    Run body(i) for i = 0 ... n-1 and wait for all of them.
+  ------------------------------------------------------------------*/
+  public: template <class F> void parallelFor(int n, const F &body)
+  {
+    if (n <= 0) return;
+    if ( (n == 1) || workers.empty() ) {
+      for (int i = 0; i < n; ++i) body(i);
+      return;
+    }
+
+    Loop *loop;
+    int nhelp = std::min(n, size()) - 1;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (spare.empty()) {
+        loop = new Loop;
+      } else {
+        loop = spare.back();
+        spare.pop_back();
+      }
+      loop->call = &callBody<F>;
+      loop->body = &body;
+      loop->n = n;
+      loop->next = 0;
+      loop->done = 0;
+      loop->running = 0;
+      for (int i = 0; i < nhelp; ++i) queue.push_back(loop);
+    }
+    if (nhelp == 1) cv.notify_one(); else cv.notify_all();
+
+    runLoop(*loop);
+
+    // Drop the entries no worker has taken, wait for the ones inside.
+    std::unique_lock<std::mutex> lock(mtx);
+    queue.erase(std::remove(queue.begin(), queue.end(), loop), queue.end());
+    while ( (loop->done < n) || (loop->running > 0) ) cv_done.wait(lock);
+    spare.push_back(loop);
+  }
+
+
+  /*------------------------------------------------------------------
+    Call of the loop body of type F.
+  ------------------------------------------------------------------*/
+  private: template <class F> static void callBody(const void *body, int i)
+    { (*static_cast<const F *>(body))(i); }
+
+
+  /*------------------------------------------------------------------
+    Take iterations of the loop until none is left.
+  ------------------------------------------------------------------*/
+  private: void runLoop(Loop &loop)
+  {
+    for (int i = loop.next++; i < loop.n; i = loop.next++) {
+      loop.call(loop.body, i);
+      if (++loop.done == loop.n) {
+        std::lock_guard<std::mutex> lock(mtx);
+        cv_done.notify_all();
+      }
+    }
+  }
+
+
+  /*------------------------------------------------------------------
+    Worker thread: join queued loops until the pool is destroyed.
+  ------------------------------------------------------------------*/
+  private: void workerLoop()
+  {
+    for (;;) {
+      Loop *loop;
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!stop && queue.empty()) cv.wait(lock);
+        if (stop && queue.empty()) return;
+        loop = queue.front();
+        queue.erase(queue.begin());
+        ++loop->running;
+      }
+      runLoop(*loop);
+      std::lock_guard<std::mutex> lock(mtx);
+      if (--loop->running == 0) cv_done.notify_all();
+    }
+  }
+
+
+}; //=================================================================
+
+
+#endif // THREAD_POOL_H
+
+
+//====================================================================
@@ -0,0 +1,129 @@
+/*====================================================================
+
+  UNIFORM AXIS OF ARGUMENTS:
+
+  Most spectra and tables are sampled with a constant step. Such an
+  axis is detected once, at load, within a tolerance and kept as
+  x_i = x0 + i*dx, i = 0 ... n-1, so the cell of an argument and the
+  index range of an interval are found by one division instead of a
+  bisection or a scan of the arguments. Lookups against the stored
+  array are corrected by at most a step of rounding, so they give the
+  same cells as bisection.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef UNIFORM_AXIS_H
+#define UNIFORM_AXIS_H
+
+#include <math.h>
+#include <vector>
+
+
+// Default tolerance of the node positions, relative to the step.
+const double UNIFORM_AXIS_TOL = 1.0e-6;
+
+
+class UniformAxis
+{
+  private: double x0;     // First argument.
+  private: double dx;     // Step.
+  private: double rdx;    // Inverse step.
+  private: int n;         // Number of arguments.
+  private: bool uniform;  // Flag of the uniform axis.
+
+
+  /*------------------------------------------------------------------
+    Constructor.
+  ------------------------------------------------------------------*/
+  public: UniformAxis()
+    { clear(); }
+
+
+  /*------------------------------------------------------------------
+    Clear object: the axis is not uniform.
+  ------------------------------------------------------------------*/
+  public: void clear()
+    { x0 = 0.0; dx = 0.0; rdx = 0.0; n = 0; uniform = false; }
+
+
+  /*------------------------------------------------------------------
+    Detect the uniform step of the ascending arguments "x": every
+    node is within "tol" steps of x0 + i*dx. Returns the flag of the
+    uniform axis.
+  ------------------------------------------------------------------*/
+  public: bool init(const double *x, int n_, double tol = UNIFORM_AXIS_TOL)
+  {
+    clear();
+    if (n_ < 2) return false;
+    double step = (x[n_-1] - x[0])/(n_ - 1);
+    if (!(step > 0.0)) return false;
+    for (int i = 1; i < n_ - 1; ++i)
+      if (fabs(x[i] - (x[0] + i*step)) > tol*step) return false;
+    x0 = x[0]; dx = step; rdx = 1.0/step; n = n_;
+    uniform = true;
+    return true;
+  }
+
+  public: bool init(const std::vector<double> &x, double tol = UNIFORM_AXIS_TOL)
+    { return init(x.data(), x.size(), tol); }
+
+
+  /*------------------------------------------------------------------
+    Get functions.
+  ------------------------------------------------------------------*/
+  public: bool isUniform() const { return uniform; }
+  public: int size() const { return n; }
+  public: double getStart() const { return x0; }
+  public: double getStep() const { return dx; }
+  public: double at(int i) const { return x0 + i*dx; }
+
+
+  /*------------------------------------------------------------------
+    Index "i" of the cell [a[i], a[i+1]] containing "v", in [0, n-2];
+    values outside the axis are referred to the boundary cells. The
+    guess is corrected against the array "a" of the nodes, or against
+    the implicit nodes without it.
+  ------------------------------------------------------------------*/
+  public: int locate(double v, const double *a = NULL) const
+  {
+    double t = (v - x0)*rdx;
+    int i = (t >= 0.0) ? ( (t < n - 2) ? int(t) : n - 2 ) : 0;
+    if (a != NULL) {
+      while ( (i > 0) && (a[i] > v) ) --i;
+      while ( (i < n - 2) && (a[i+1] <= v) ) ++i;
+    } else {
+      while ( (i > 0) && (at(i) > v) ) --i;
+      while ( (i < n - 2) && (at(i + 1) <= v) ) ++i;
+    }
+    return i;
+  }
+
+
+  /*------------------------------------------------------------------
+    Range [i_min, i_max] of the nodes within [v_min, v_max]; empty
+    (i_min > i_max) if there are none.
+  ------------------------------------------------------------------*/
+  public: void range(double v_min, double v_max, int &i_min, int &i_max) const
+  {
+    double t = ceil((v_min - x0)*rdx);
+    i_min = (t > 0.0) ? ( (t < n) ? int(t) : n ) : 0;
+    while ( (i_min > 0) && (at(i_min - 1) >= v_min) ) --i_min;
+    while ( (i_min < n) && (at(i_min) < v_min) ) ++i_min;
+    t = floor((v_max - x0)*rdx);
+    i_max = (t >= 0.0) ? ( (t < n - 1) ? int(t) : n - 1 ) : -1;
+    while ( (i_max < n - 1) && (at(i_max + 1) <= v_max) ) ++i_max;
+    while ( (i_max >= 0) && (at(i_max) > v_max) ) --i_max;
+  }
+
+
+}; //=================================================================
+
+
+#endif // UNIFORM_AXIS_H
+
+
+//====================================================================
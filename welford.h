@@ -0,0 +1,122 @@
+/*====================================================================
+
+  STREAMING MEAN AND VARIANCE OF STACKED SCANS:
+
+  Scans resampled on a common grid are folded one by one into running
+  means and sums of squared deviations (Welford), so the memory does
+  not depend on the number of scans and one pass over them is enough.
+  Partial stacks of separate workers are merged exactly (Chan et al.),
+  which gives the same moments as a single stack of all scans.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef WELFORD_H
+#define WELFORD_H
+
+#include <math.h>
+#include <vector>
+
+
+class WelfordStack
+{
+  private: long n;                  // Number of stacked scans.
+  private: int ncol;                // Number of values per point.
+  private: size_t npoint;           // Number of grid points.
+  private: std::vector<double> mean;  // Running means, point by point.
+  private: std::vector<double> m2;    // Sums of squared deviations.
+
+
+  /*------------------------------------------------------------------
+    Constructor.
+  ------------------------------------------------------------------*/
+  public: WelfordStack(size_t npoint_ = 0)
+    { init(npoint_); }
+
+
+  /*------------------------------------------------------------------
+    Empty stack of scans of "npoint_" grid points. The number of
+    values per point is set by the first scan.
+  ------------------------------------------------------------------*/
+  public: void init(size_t npoint_)
+  {
+    n = 0;
+    ncol = 0;
+    npoint = npoint_;
+    mean.clear();
+    m2.clear();
+  }
+
+
+  /*------------------------------------------------------------------
+    Fold in the scan "v" of "ncol_" values per point, point by point.
+    Returns false (scan skipped) if the number of values differs from
+    the one of the stack.
+  ------------------------------------------------------------------*/
+  public: bool add(const double *v, int ncol_)
+  {
+    if (n == 0) {
+      ncol = ncol_;
+      mean.assign(npoint*ncol, 0.0);
+      m2.assign(npoint*ncol, 0.0);
+    } else if (ncol_ != ncol)
+      return false;
+    ++n;
+    double rn = 1.0/n;
+    for (size_t i = 0; i < mean.size(); ++i) {
+      double d = v[i] - mean[i];
+      mean[i] += d*rn;
+      m2[i] += d*(v[i] - mean[i]);
+    }
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Merge the partial stack "o" of the same grid. Returns false if
+    the numbers of values per point differ.
+  ------------------------------------------------------------------*/
+  public: bool merge(const WelfordStack &o)
+  {
+    if (o.n == 0) return true;
+    if (n == 0) {
+      n = o.n; ncol = o.ncol;
+      mean = o.mean; m2 = o.m2;
+      return true;
+    }
+    if (o.ncol != ncol) return false;
+    double na = n, nb = o.n, nab = na + nb;
+    for (size_t i = 0; i < mean.size(); ++i) {
+      double d = o.mean[i] - mean[i];
+      mean[i] += d*nb/nab;
+      m2[i] += o.m2[i] + d*d*na*nb/nab;
+    }
+    n += o.n;
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Get functions: mean of the value "k" at the point "i" and its
+    standard error (zero for less than two scans).
+  ------------------------------------------------------------------*/
+  public: long getCount() { return n; }
+  public: int getColumnNum() { return ncol; }
+
+  public: double getMean(size_t i, int k)
+    { return mean[i*ncol + k]; }
+
+  public: double getStdErr(size_t i, int k)
+    { return (n > 1) ? sqrt(m2[i*ncol + k]/((n - 1.0)*n)) : 0.0; }
+
+
+}; //=================================================================
+
+
+#endif // WELFORD_H
+
+
+//====================================================================
@@ -0,0 +1,450 @@
+/*====================================================================
+
+  TRANSPARENT DECOMPRESSION OF DATA FILES:
+
+  DataInputStream is used in place of std::ifstream by the readers.
+  Compressed files are detected by their magic bytes and decompressed
+  on the fly, chunk by chunk, straight into the parser, so no
+  temporary files are needed:
+    gzip (.gz)  : compile with -DHAVE_ZLIB -lz;
+    zstd (.zst) : compile with -DHAVE_ZSTD -lzstd.
+  With "threaded" set, decompression runs on its own thread ahead of
+  the parser (libzstd and zlib decompress a stream in one thread).
+  Otherwise the chunk buffer is borrowed from the arena of the
+  reading thread (see arena.h) and is not allocated again per file.
+  A read error, a corrupted or truncated compressed file, or one of
+  the unsupported kind ends the stream with the message kept by
+  DataInputStream::error(), to be checked after reading.
+
+  ACKNOWLEDGEMENT(S): Alexey D. Kondorskiy,
+    P.N.Lebedev Physical Institute of the Russian Academy of Science.
+    E-mail: kondorskiy@lebedev.ru, kondorskiy@gmail.com.
+
+====================================================================*/
+
+#ifndef ZSTREAM_H
+#define ZSTREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <istream>
+#include <iostream>
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "arena.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+
+/*--------------------------------------------------------------------
+  Kinds of data files.
+--------------------------------------------------------------------*/
+const int ZSTREAM_PLAIN = 0;
+const int ZSTREAM_GZIP = 1;
+const int ZSTREAM_ZSTD = 2;
+
+// Size of decompressed chunks passed to the parser.
+const size_t ZSTREAM_CHUNK = 1 << 18;
+
+
+/*--------------------------------------------------------------------
+  Kind of data by its first bytes.
+--------------------------------------------------------------------*/
+inline int zstreamKind(const unsigned char *p, size_t n)
+{
+  if ( (n >= 2) && (p[0] == 0x1f) && (p[1] == 0x8b) )
+    return ZSTREAM_GZIP;
+  if ( (n >= 4) && (p[0] == 0x28) && (p[1] == 0xb5) && (p[2] == 0x2f)
+    && (p[3] == 0xfd) )
+    return ZSTREAM_ZSTD;
+  return ZSTREAM_PLAIN;
+}
+
+
+/*--------------------------------------------------------------------
+  Message on a compressed file the program was built without support
+  for.
+--------------------------------------------------------------------*/
+inline std::string zstreamUnsupported(const std::string &name, int kind)
+{
+  return "File " + name + " is compressed with "
+    + ((kind == ZSTREAM_GZIP) ? "gzip, compile with -DHAVE_ZLIB -lz"
+      : "zstd, compile with -DHAVE_ZSTD -lzstd") + "!";
+}
+
+
+/*--------------------------------------------------------------------
+  Decompress the whole contents of a file already read to memory.
+  Plain contents are left as they are. Returns false if the contents
+  are corrupted or truncated or of the unsupported kind, the message
+  is set to "err".
+--------------------------------------------------------------------*/
+inline bool zstreamDecode(
+  const std::string &name,  // Name of the file for error message.
+  std::string &data,        // File contents, replaced by decompressed.
+  std::string &err)         // Error message.
+{
+  int kind = zstreamKind((const unsigned char *) data.data(), data.size());
+  if (kind == ZSTREAM_PLAIN) return true;
+  std::string out;
+
+#ifdef HAVE_ZLIB
+  if (kind == ZSTREAM_GZIP) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+      err = "File " + name + " can not be decompressed!";
+      return false;
+    }
+    zs.next_in = (Bytef *) data.data();
+    zs.avail_in = data.size();
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+      size_t old = out.size();
+      out.resize(old + ZSTREAM_CHUNK);
+      zs.next_out = (Bytef *) &out[old];
+      zs.avail_out = ZSTREAM_CHUNK;
+      ret = inflate(&zs, Z_NO_FLUSH);
+      out.resize(old + ZSTREAM_CHUNK - zs.avail_out);
+      if ( (ret == Z_STREAM_END) && (zs.avail_in > 0) ) {
+        inflateReset(&zs);        // Next gzip member.
+        ret = Z_OK;
+      }
+      if ( (ret != Z_OK) && (ret != Z_STREAM_END) ) {
+        inflateEnd(&zs);
+        err = "File " + name + " is corrupted or truncated!";
+        return false;
+      }
+    }
+    inflateEnd(&zs);
+    data.swap(out);
+    return true;
+  }
+#endif
+
+#ifdef HAVE_ZSTD
+  if (kind == ZSTREAM_ZSTD) {
+    ZSTD_DStream *zds = ZSTD_createDStream();
+    ZSTD_inBuffer in = { data.data(), data.size(), 0 };
+    size_t ret = 1;   // Nonzero while a frame is not complete.
+    while ( (in.pos < in.size) || (ret != 0) ) {
+      size_t old = out.size();
+      out.resize(old + ZSTREAM_CHUNK);
+      ZSTD_outBuffer ob = { &out[old], ZSTREAM_CHUNK, 0 };
+      ret = ZSTD_decompressStream(zds, &ob, &in);
+      out.resize(old + ob.pos);
+      if (ZSTD_isError(ret)) {
+        ZSTD_freeDStream(zds);
+        err = "File " + name + " is corrupted (" + ZSTD_getErrorName(ret) + ")!";
+        return false;
+      }
+      // All input used and the output not filled: nothing more comes.
+      if ( (in.pos == in.size) && (ret != 0) && (ob.pos < ob.size) ) {
+        ZSTD_freeDStream(zds);
+        err = "File " + name + " is truncated!";
+        return false;
+      }
+    }
+    ZSTD_freeDStream(zds);
+    data.swap(out);
+    return true;
+  }
+#endif
+
+  err = zstreamUnsupported(name, kind);
+  return false;
+}
+
+
+/*--------------------------------------------------------------------
+  Buffers kept by each thread opening files.
+--------------------------------------------------------------------*/
+struct DataStreamArena
+{
+  std::vector<char> chunk;   // Chunk given to the parser.
+  std::vector<char> zbuf;    // Compressed input of zstd files.
+};
+
+
+/*--------------------------------------------------------------------
+  Stream buffer giving decompressed contents of a file chunk by
+  chunk.
+--------------------------------------------------------------------*/
+class DataStreamBuf : public std::streambuf
+{
+  private: int kind;                // Kind of the file.
+  private: FILE *fin;               // Plain or zstd file.
+#ifdef HAVE_ZLIB
+  private: gzFile gin;              // Gzip file.
+#endif
+#ifdef HAVE_ZSTD
+  private: ZSTD_DStream *zds;       // Zstd decompression state.
+  private: std::vector<char> zbuf;  // Compressed input.
+  private: ZSTD_inBuffer zin;
+  private: size_t zleft;            // Nonzero while a frame is not complete.
+#endif
+  private: std::vector<char> buf;   // Chunk given to the parser.
+  private: bool borrowed;           // "buf" is taken from the arena.
+  private: std::string name;        // Name of the file.
+  private: std::string err;         // Error message, empty if none.
+
+  // Decompression thread and chunks decompressed ahead.
+  private: bool threaded;
+  private: std::thread worker;
+  private: std::vector<std::vector<char> > ready;   // At most four, oldest first.
+  private: bool finished;
+  private: bool at_end;             // The end is given to the parser.
+  private: std::mutex mtx;
+  private: std::condition_variable cv;
+
+
+  /*------------------------------------------------------------------
+    Constructor & Destructor.
+  ------------------------------------------------------------------*/
+  public: DataStreamBuf()
+  {
+    kind = ZSTREAM_PLAIN; fin = NULL;
+#ifdef HAVE_ZLIB
+    gin = NULL;
+#endif
+#ifdef HAVE_ZSTD
+    zds = NULL;
+#endif
+    threaded = false; finished = true; at_end = true; borrowed = false;
+  }
+
+  public: ~DataStreamBuf()
+    { close(); }
+
+
+  /*------------------------------------------------------------------
+    Open the file. Returns false if it can not be opened or is of the
+    unsupported kind, see error().
+  ------------------------------------------------------------------*/
+  public: bool open(const std::string &file_name, bool thr)
+  {
+    close();
+    name = file_name;
+    err.clear();
+    fin = fopen(name.c_str(), "rb");
+    if (fin == NULL) { err = "File " + name + " not found!"; return false; }
+    unsigned char magic[4];
+    size_t n = fread(magic, 1, 4, fin);
+    kind = zstreamKind(magic, n);
+    rewind(fin);
+
+    if (kind == ZSTREAM_GZIP) {
+#ifdef HAVE_ZLIB
+      fclose(fin); fin = NULL;
+      gin = gzopen(name.c_str(), "rb");
+      if (gin == NULL) { err = "File " + name + " not found!"; return false; }
+      gzbuffer(gin, ZSTREAM_CHUNK);
+#else
+      err = zstreamUnsupported(name, kind);
+      fclose(fin); fin = NULL;
+      return false;
+#endif
+    }
+    if (kind == ZSTREAM_ZSTD) {
+#ifdef HAVE_ZSTD
+      zds = ZSTD_createDStream();
+      zbuf.swap(workerArena<DataStreamArena>().zbuf);
+      zbuf.resize(ZSTD_DStreamInSize());
+      zin.src = &zbuf[0]; zin.size = 0; zin.pos = 0;
+      zleft = 1;
+#else
+      err = zstreamUnsupported(name, kind);
+      fclose(fin); fin = NULL;
+      return false;
+#endif
+    }
+
+    threaded = thr;
+    if (!threaded) {
+      buf.swap(workerArena<DataStreamArena>().chunk);
+      borrowed = true;
+    }
+    buf.resize(ZSTREAM_CHUNK);
+    setg(&buf[0], &buf[0], &buf[0]);
+    at_end = false;
+    if (threaded) {
+      finished = false;
+      worker = std::thread(&DataStreamBuf::workerLoop, this);
+    }
+    return true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Close the file.
+  ------------------------------------------------------------------*/
+  public: void close()
+  {
+    if (worker.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        finished = true;
+      }
+      cv.notify_all();
+      worker.join();
+    }
+    ready.clear();
+    if (fin != NULL) { fclose(fin); fin = NULL; }
+#ifdef HAVE_ZLIB
+    if (gin != NULL) { gzclose(gin); gin = NULL; }
+#endif
+#ifdef HAVE_ZSTD
+    if (zds != NULL) {
+      ZSTD_freeDStream(zds); zds = NULL;
+      zbuf.swap(workerArena<DataStreamArena>().zbuf);
+    }
+#endif
+    if (borrowed) {
+      setg(NULL, NULL, NULL);
+      buf.swap(workerArena<DataStreamArena>().chunk);
+      borrowed = false;
+    }
+    threaded = false;
+    at_end = true;
+  }
+
+
+  /*------------------------------------------------------------------
+    Message on the failed open or read, empty if none. Valid once the
+    stream has ended.
+  ------------------------------------------------------------------*/
+  public: const std::string &error() const
+    { return err; }
+
+
+  /*------------------------------------------------------------------
+    Give the next chunk to the parser.
+  ------------------------------------------------------------------*/
+  protected: virtual int_type underflow()
+  {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    if (at_end) return traits_type::eof();
+    size_t n;
+    if (threaded) {
+      std::unique_lock<std::mutex> lock(mtx);
+      while (ready.empty()) cv.wait(lock);
+      buf.swap(ready.front());
+      ready.erase(ready.begin());
+      cv.notify_all();
+      n = buf.size();
+    } else {
+      buf.resize(ZSTREAM_CHUNK);
+      n = fill(&buf[0], buf.size());
+    }
+    at_end = (n == 0);
+    if (n == 0) return traits_type::eof();
+    setg(&buf[0], &buf[0], &buf[0] + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+
+  /*------------------------------------------------------------------
+    Decompress up to "size" bytes into "p". Returns 0 at the end or
+    on an error, which is kept in "err".
+  ------------------------------------------------------------------*/
+  private: size_t fill(char *p, size_t size)
+  {
+#ifdef HAVE_ZLIB
+    if (kind == ZSTREAM_GZIP) {
+      int n = gzread(gin, p, size);
+      if (n > 0) return n;
+      int e = Z_OK;
+      gzerror(gin, &e);
+      if ( (n < 0) || (e != Z_OK) )
+        err = "File " + name + " is corrupted or truncated!";
+      return 0;
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (kind == ZSTREAM_ZSTD) {
+      ZSTD_outBuffer out = { p, size, 0 };
+      while (out.pos == 0) {
+        if (zin.pos == zin.size) {
+          zin.size = fread(&zbuf[0], 1, zbuf.size(), fin);
+          zin.pos = 0;
+          if (zin.size == 0) {
+            if (ferror(fin)) err = "Read error in file " + name + "!";
+            else if (zleft != 0) err = "File " + name + " is truncated!";
+            break;
+          }
+        }
+        zleft = ZSTD_decompressStream(zds, &out, &zin);
+        if (ZSTD_isError(zleft)) {
+          err = "File " + name + " is corrupted ("
+            + ZSTD_getErrorName(zleft) + ")!";
+          return 0;
+        }
+      }
+      return out.pos;
+    }
+#endif
+    size_t n = fread(p, 1, size, fin);
+    if ( (n == 0) && ferror(fin) ) err = "Read error in file " + name + "!";
+    return n;
+  }
+
+
+  /*------------------------------------------------------------------
+    Decompression thread: keeps up to four chunks ahead of the parser,
+    an empty chunk marks the end.
+  ------------------------------------------------------------------*/
+  private: void workerLoop()
+  {
+    for (;;) {
+      std::vector<char> chunk(ZSTREAM_CHUNK);
+      chunk.resize(fill(&chunk[0], chunk.size()));
+      bool end = chunk.empty();
+      std::unique_lock<std::mutex> lock(mtx);
+      while (!finished && (ready.size() >= 4)) cv.wait(lock);
+      if (finished) return;
+      ready.push_back(std::vector<char>());
+      ready.back().swap(chunk);
+      cv.notify_all();
+      if (end) return;
+    }
+  }
+};
+
+
+/*--------------------------------------------------------------------
+  Input stream of a plain or compressed data file.
+--------------------------------------------------------------------*/
+class DataInputStream : public std::istream
+{
+  private: DataStreamBuf sb;
+
+  public: DataInputStream(const std::string &name, bool threaded = false)
+    : std::istream(NULL)
+  {
+    rdbuf(&sb);
+    if (!sb.open(name, threaded)) setstate(std::ios::failbit);
+  }
+
+  public: void close()
+    { sb.close(); }
+
+  // Message on the failed open or read, empty if none: the data read
+  // are not complete unless it is empty at the end of the stream.
+  public: const std::string &error() const
+    { return sb.error(); }
+};
+
+
+#endif // ZSTREAM_H
+
+
+//====================================================================